@@ -57,7 +57,7 @@ MainPanel::MainPanel(Resources & res) : mLayout(this)
     mLayout.addWidget(new MainMenuButton(res, this));
     mLayout.addWidget(new QuickLaunch(res, this));
     mLayout.addWidget(new TaskBar(res, this));
-    mLayout.addWidget(new StatusNotifier(this));
+    mLayout.addWidget(new StatusNotifier(res, this));
     mLayout.addWidget(new ClockLabel(this));
 
     mLayout.setStretch(2, 1); // stretch taskbar
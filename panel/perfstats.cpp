@@ -0,0 +1,105 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "perfstats.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QMap>
+#include <QTimer>
+
+struct PerfTime
+{
+    qint64 calls = 0;
+    qint64 total = 0; // nsecs
+    qint64 max = 0;   // nsecs
+};
+
+static QMap<QByteArray, qint64> sCounts;
+static QMap<QByteArray, PerfTime> sTimes;
+
+static void dumpStats()
+{
+    for (auto it = sCounts.cbegin(); it != sCounts.cend(); ++it)
+        qDebug().noquote() << "stats:" << it.key() << it.value() << "/ min";
+
+    for (auto it = sTimes.cbegin(); it != sTimes.cend(); ++it)
+    {
+        auto & time = it.value();
+        qDebug().noquote() << "stats:" << it.key() << time.calls
+                           << "/ min, avg" << (time.total / time.calls / 1000)
+                           << "us, max" << (time.max / 1000) << "us";
+    }
+
+    sCounts.clear();
+    sTimes.clear();
+}
+
+static void startDumpTimer()
+{
+    static QTimer * timer = nullptr;
+    if (!timer)
+    {
+        timer = new QTimer(QCoreApplication::instance());
+        QObject::connect(timer, &QTimer::timeout, dumpStats);
+        timer->start(60000);
+    }
+}
+
+bool perfStatsEnabled()
+{
+    static const bool enabled = qEnvironmentVariableIsSet("QMPANEL_STATS");
+    return enabled;
+}
+
+void perfCount(const char * name, qint64 amount)
+{
+    if (!perfStatsEnabled())
+        return;
+
+    startDumpTimer();
+    sCounts[name] += amount;
+}
+
+PerfTimer::PerfTimer(const char * name) : mName(name)
+{
+    if (perfStatsEnabled())
+        mTimer.start();
+}
+
+PerfTimer::~PerfTimer()
+{
+    if (!mTimer.isValid())
+        return;
+
+    qint64 elapsed = mTimer.nsecsElapsed();
+    startDumpTimer();
+
+    auto & time = sTimes[mName];
+    time.calls++;
+    time.total += elapsed;
+    time.max = qMax(time.max, elapsed);
+}
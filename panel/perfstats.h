@@ -0,0 +1,53 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef PERFSTATS_H
+#define PERFSTATS_H
+
+#include <QElapsedTimer>
+#include <QtGlobal>
+
+// Lightweight counters for comparing the cost of different code paths.
+// When QMPANEL_STATS is set in the environment, the totals are written
+// to the debug log once per minute and then reset.  Otherwise counting
+// is a no-op.
+bool perfStatsEnabled();
+void perfCount(const char * name, qint64 amount = 1);
+
+// Measures the time spent in a scope.  The number of calls and the
+// average and maximum times are logged along with the counters.
+class PerfTimer
+{
+public:
+    explicit PerfTimer(const char * name);
+    ~PerfTimer();
+
+private:
+    const char * mName;
+    QElapsedTimer mTimer;
+};
+
+#endif // PERFSTATS_H
@@ -49,14 +49,22 @@ QStringList AppInfo::categories() const
         .split(';', Qt::SkipEmptyParts);
 }
 
-QIcon AppInfo::getIcon() const
+QIcon AppInfo::getIcon()
 {
+    if (mIcon)
+        return *mIcon;
+
+    QIcon icon;
     auto gicon = g_app_info_get_icon((GAppInfo *)mInfo.get());
-    if (!gicon)
-        return QIcon();
+    if (gicon)
+    {
+        CharPtr name(g_icon_to_string(gicon), g_free);
+        if (name)
+            icon = Resources::getIcon(QString(name));
+    }
 
-    CharPtr name(g_icon_to_string(gicon), g_free);
-    return name ? Resources::getIcon(QString(name)) : QIcon();
+    mIcon = std::make_unique<QIcon>(icon);
+    return icon;
 }
 
 QAction * AppInfo::getAction()
@@ -141,6 +149,55 @@ Resources::AppNameMap Resources::makeAppNameMap(AppInfoMap & appInfos)
     return nameMap;
 }
 
+// Create mapping of X11 WM_CLASS names to full .desktop file name.
+// StartupWMClass takes priority, then the application name (full or
+// short), then the basename of the executable (if unique).
+Resources::AppNameMap Resources::makeWMClassMap(AppInfoMap & appInfos)
+{
+    auto nameMap = AppNameMap();
+    for (auto & pair : appInfos)
+    {
+        auto info = pair.second.info();
+        QString wmClass = g_desktop_app_info_get_startup_wm_class(info);
+        if (!wmClass.isEmpty())
+            nameMap.emplace(wmClass.toLower(), pair.first);
+    }
+
+    for (auto & pair : appInfos)
+    {
+        QString name = pair.first;
+        name.remove(QRegularExpression("\\.desktop$"));
+        nameMap.emplace(name.toLower(), pair.first);
+        name.remove(QRegularExpression(".*\\."));
+        nameMap.emplace(name.toLower(), pair.first);
+    }
+
+    // Generic launchers (env, sh, flatpak, python3, ...) are the Exec
+    // of many .desktop files and say nothing about the application, so
+    // only basenames belonging to a single .desktop file are used
+    auto execMap = AppNameMap();
+    std::unordered_set<QString> shared;
+    for (auto & pair : appInfos)
+    {
+        auto exec = g_app_info_get_executable((GAppInfo *)pair.second.info());
+        if (exec)
+        {
+            CharPtr base(g_path_get_basename(exec), g_free);
+            auto name = QString(base).toLower();
+            if (!execMap.emplace(name, pair.first).second)
+                shared.insert(name);
+        }
+    }
+
+    for (auto & pair : execMap)
+    {
+        if (!shared.count(pair.first))
+            nameMap.emplace(pair.first, pair.second);
+    }
+
+    return nameMap;
+}
+
 Resources::Settings Resources::loadSettings()
 {
     AutoPtr<GKeyFile> kf(g_key_file_new(), g_key_file_unref);
@@ -158,11 +215,23 @@ Resources::Settings Resources::loadSettings()
     auto pinnedMenuApps = getSetting("PinnedMenuApps");
     auto quickLaunchApps = getSetting("QuickLaunchApps");
     auto launchCmds = getSetting("LaunchCmds");
+    auto taskBarUpdateRate = getSetting("TaskBarUpdateRate");
+    auto taskBarEventFilter = g_key_file_get_boolean(
+        kf.get(), "Settings", "TaskBarEventFilter", nullptr);
+    auto taskBarScreenOnly = g_key_file_get_boolean(
+        kf.get(), "Settings", "TaskBarScreenOnly", nullptr);
+    auto trayUpdateInterval = getSetting("TrayUpdateInterval");
+    auto trayMenuPrefetch = getSetting("TrayMenuPrefetch");
 
     return {menuIcon.isEmpty() ? "start-here" : menuIcon,
             pinnedMenuApps.split(';', Qt::SkipEmptyParts),
             quickLaunchApps.split(';', Qt::SkipEmptyParts),
-            launchCmds.split(';', Qt::SkipEmptyParts)};
+            launchCmds.split(';', Qt::SkipEmptyParts),
+            taskBarUpdateRate.toInt(),
+            (bool)taskBarEventFilter,
+            (bool)taskBarScreenOnly,
+            trayUpdateInterval.isEmpty() ? 100 : trayUpdateInterval.toInt(),
+            trayMenuPrefetch.toInt()};
 }
 
 QIcon Resources::getAppIcon(const QString & appName)
@@ -185,6 +254,27 @@ QIcon Resources::getAppIcon(const QString & appName)
     return QIcon();
 }
 
+// returns a null icon (without warning) if there is no match
+QIcon Resources::getWMClassIcon(const QString & instance,
+                                const QString & wmClass)
+{
+    for (auto & name : {wmClass, instance})
+    {
+        if (name.isEmpty())
+            continue;
+
+        auto nameIter = mWMClassMap.find(name.toLower());
+        if (nameIter == mWMClassMap.end())
+            continue;
+
+        auto iter = mAppInfos.find(nameIter->second);
+        if (iter != mAppInfos.end())
+            return iter->second.getIcon();
+    }
+
+    return QIcon();
+}
+
 // note: appID includes ".desktop" suffix
 QAction * Resources::getAction(const QString & appID)
 {
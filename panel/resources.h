@@ -43,13 +43,15 @@ class AppInfo
 public:
     explicit AppInfo(GDesktopAppInfo * info);
 
+    GDesktopAppInfo * info() const { return mInfo.get(); }
     QStringList categories() const;
-    QIcon getIcon() const;
+    QIcon getIcon();
     QAction * getAction();
 
 private:
     AutoPtrV<GDesktopAppInfo> mInfo;
     std::unique_ptr<QAction> mAction;
+    std::unique_ptr<QIcon> mIcon;
 };
 
 class Resources
@@ -61,6 +63,11 @@ public:
         QStringList pinnedMenuApps;
         QStringList quickLaunchApps;
         QStringList launchCmds;
+        int taskBarUpdateRate;
+        bool taskBarEventFilter;
+        bool taskBarScreenOnly;
+        int trayUpdateInterval;
+        int trayMenuPrefetch;
     };
 
     static QIcon getIcon(const QString & name);
@@ -68,6 +75,7 @@ public:
     const Settings & settings() const { return mSettings; }
 
     QIcon getAppIcon(const QString & appName);
+    QIcon getWMClassIcon(const QString & instance, const QString & wmClass);
     QAction * getAction(const QString & appID);
     QList<QAction *> getCategory(const QString & category,
                                  std::unordered_set<QString> & added);
@@ -78,10 +86,12 @@ private:
 
     static AppInfoMap loadAppInfos();
     static AppNameMap makeAppNameMap(AppInfoMap & appInfos);
+    static AppNameMap makeWMClassMap(AppInfoMap & appInfos);
     static Settings loadSettings();
 
     AppInfoMap mAppInfos = loadAppInfos();
     AppNameMap mAppNameMap = makeAppNameMap(mAppInfos);
+    AppNameMap mWMClassMap = makeWMClassMap(mAppInfos);
     Settings mSettings = loadSettings();
 };
 
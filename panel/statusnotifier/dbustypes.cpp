@@ -74,3 +74,17 @@ const QDBusArgument & operator>>(const QDBusArgument & argument,
     argument.endStructure();
     return argument;
 }
+
+// Retrieve only the ToolTip title from the D-Bus argument
+QString toolTipTitle(const QDBusArgument & argument)
+{
+    QString iconName, title;
+    argument.beginStructure();
+    argument >> iconName;
+    // skip over the pixmaps without reading them
+    argument.beginArray();
+    argument.endArray();
+    argument >> title;
+    argument.endStructure();
+    return title;
+}
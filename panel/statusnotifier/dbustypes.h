@@ -55,6 +55,9 @@ QDBusArgument & operator<<(QDBusArgument & argument, const ToolTip & toolTip);
 const QDBusArgument & operator>>(const QDBusArgument & argument,
                                  ToolTip & toolTip);
 
+// Reads only the title, without decoding the pixmaps
+QString toolTipTitle(const QDBusArgument & argument);
+
 Q_DECLARE_METATYPE(IconPixmap)
 Q_DECLARE_METATYPE(ToolTip)
 
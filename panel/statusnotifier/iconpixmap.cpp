@@ -0,0 +1,174 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "iconpixmap.h"
+
+#include <QHashFunctions>
+#include <QtEndian>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+typedef void (*ByteSwapFunc)(const uchar * src, uchar * dest, size_t count);
+
+static void byteSwapScalar(const uchar * src, uchar * dest, size_t count)
+{
+    qFromBigEndian<quint32>(src, count, dest);
+}
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target("ssse3"))) static void
+byteSwapSSSE3(const uchar * src, uchar * dest, size_t count)
+{
+    const __m128i mask =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        auto v = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+        _mm_storeu_si128((__m128i *)(dest + 4 * i), _mm_shuffle_epi8(v, mask));
+    }
+
+    byteSwapScalar(src + 4 * i, dest + 4 * i, count - i);
+}
+
+__attribute__((target("avx2"))) static void
+byteSwapAVX2(const uchar * src, uchar * dest, size_t count)
+{
+    const __m256i mask = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, //
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        auto v = _mm256_loadu_si256((const __m256i *)(src + 4 * i));
+        _mm256_storeu_si256((__m256i *)(dest + 4 * i),
+                            _mm256_shuffle_epi8(v, mask));
+    }
+
+    byteSwapScalar(src + 4 * i, dest + 4 * i, count - i);
+}
+
+#endif // HAVE_X86_SIMD
+
+static ByteSwapFunc pickByteSwap()
+{
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return byteSwapAVX2;
+    if (__builtin_cpu_supports("ssse3"))
+        return byteSwapSSSE3;
+#endif
+    return byteSwapScalar;
+}
+
+// swaps count 32-bit words from big-endian to host order
+static void byteSwap32(const uchar * src, uchar * dest, size_t count)
+{
+    static const ByteSwapFunc func = pickByteSwap();
+    func(src, dest, count);
+}
+
+static bool isValid(const IconPixmap & pixmap)
+{
+    return pixmap.width > 0 && pixmap.height > 0 &&
+           pixmap.width <= MaxIconPixmapSize &&
+           pixmap.height <= MaxIconPixmapSize &&
+           pixmap.bytes.size() == 4 * pixmap.width * pixmap.height;
+}
+
+const IconPixmap * bestIconPixmap(const IconPixmapList & pixmaps, int size)
+{
+    const IconPixmap * best = nullptr;
+    int bestSize = 0;
+
+    for (auto & pixmap : pixmaps)
+    {
+        if (!isValid(pixmap))
+            continue;
+
+        int pixmapSize = qMax(pixmap.width, pixmap.height);
+        bool better = (bestSize < size) ? (pixmapSize > bestSize)
+                                        : (pixmapSize >= size &&
+                                           pixmapSize < bestSize);
+        if (!best || better)
+        {
+            best = &pixmap;
+            bestSize = pixmapSize;
+        }
+    }
+
+    return best;
+}
+
+QImage imageFromIconPixmap(const IconPixmap & pixmap)
+{
+    if (!isValid(pixmap))
+        return QImage();
+
+    // 32-bit rows are never padded, so the image is contiguous
+    QImage image(pixmap.width, pixmap.height, QImage::Format_ARGB32);
+    if (image.isNull())
+        return image;
+
+    byteSwap32((const uchar *)pixmap.bytes.constData(), image.bits(),
+               (size_t)pixmap.width * pixmap.height);
+    return image;
+}
+
+bool IconCacheKey::Source::operator==(const Source & other) const
+{
+    return name == other.name && themePath == other.themePath &&
+           themeGeneration == other.themeGeneration &&
+           width == other.width && height == other.height &&
+           bytes == other.bytes;
+}
+
+bool IconCacheKey::operator==(const IconCacheKey & other) const
+{
+    return icon == other.icon && overlay == other.overlay &&
+           deviceSize == other.deviceSize;
+}
+
+static size_t hashSource(const IconCacheKey::Source & source)
+{
+    return qHashMulti(0, source.name, source.themePath,
+                      source.themeGeneration, source.width, source.height,
+                      source.bytes);
+}
+
+size_t IconCacheKey::Hash::operator()(const IconCacheKey & key) const
+{
+    return qHashMulti(0, hashSource(key.icon), hashSource(key.overlay),
+                      key.deviceSize);
+}
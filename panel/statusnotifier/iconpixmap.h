@@ -0,0 +1,74 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef ICONPIXMAP_H
+#define ICONPIXMAP_H
+
+#include "dbustypes.h"
+
+#include <QImage>
+
+// Larger pixmaps are ignored rather than decoded
+constexpr int MaxIconPixmapSize = 512;
+
+// Picks the pixmap best suited for the given size (in device pixels):
+// the smallest one at least that large, or else the largest one.
+// Returns null if there are no valid pixmaps.
+const IconPixmap * bestIconPixmap(const IconPixmapList & pixmaps, int size);
+
+// Converts from network byte order ARGB32
+QImage imageFromIconPixmap(const IconPixmap & pixmap);
+
+// Identifies a rendered tray icon, for sharing between items.  An icon
+// given by name depends on the theme directory it is looked up in (and
+// that directory's contents), one given as pixmaps on the pixmap used.
+// Keys are compared in full, so a hash collision cannot show another
+// item's icon.
+struct IconCacheKey
+{
+    struct Source
+    {
+        QString name;
+        QString themePath;
+        int themeGeneration = 0;
+        int width = 0, height = 0;
+        QByteArray bytes; // implicitly shared with the item's copy
+
+        bool operator==(const Source & other) const;
+    };
+
+    Source icon, overlay;
+    int deviceSize = 0;
+
+    bool operator==(const IconCacheKey & other) const;
+
+    struct Hash
+    {
+        size_t operator()(const IconCacheKey & key) const;
+    };
+};
+
+#endif // ICONPIXMAP_H
@@ -0,0 +1,176 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "iconthemeindex.h"
+#include "../perfstats.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+
+IconThemeIndex::IconThemeIndex(std::function<void(const QString &)> changed)
+    : mChanged(std::move(changed))
+{
+    QObject::connect(&mWatcher, &QFileSystemWatcher::directoryChanged,
+                     [this](const QString & subdir) { invalidate(subdir); });
+}
+
+void IconThemeIndex::use(const QString & dir)
+{
+    if (!dir.isEmpty())
+        mIndexes[dir].users++;
+}
+
+void IconThemeIndex::release(const QString & dir)
+{
+    auto pos = mIndexes.find(dir);
+    if (pos == mIndexes.end() || --pos->users > 0)
+        return;
+
+    for (const auto & subdir : pos->watched)
+        mTopDirs.remove(subdir);
+    if (!pos->watched.isEmpty())
+        mWatcher.removePaths(pos->watched);
+
+    mIndexes.erase(pos);
+}
+
+// guesses the nominal size from directory names like "22x22", "22x22@2"
+// or "22"; "scalable" and anything unrecognized count as scalable
+static int sizeFromPath(const QString & relPath)
+{
+    for (const auto & part : relPath.split('/', Qt::SkipEmptyParts))
+    {
+        int size = part.section('x', 0, 0).section('@', 0, 0).toInt();
+        if (size > 0)
+        {
+            int scale = part.section('@', 1, 1).toInt();
+            return (scale > 1) ? size * scale : size;
+        }
+    }
+
+    return 0;
+}
+
+void IconThemeIndex::scan(const QString & dir, Index & index)
+{
+    PerfTimer timer("tray: icon theme path scans");
+
+    QDir top(dir);
+    index.files.clear();
+    index.watched = QStringList{dir};
+
+    QDirIterator it(dir, QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+        auto info = it.nextFileInfo();
+        if (info.isDir())
+        {
+            index.watched.append(info.filePath());
+            continue;
+        }
+
+        auto suffix = info.suffix().toLower();
+        if (suffix != "png" && suffix != "svg" && suffix != "svgz" &&
+            suffix != "xpm")
+            continue;
+
+        int size = suffix.startsWith("svg")
+                       ? 0
+                       : sizeFromPath(top.relativeFilePath(info.path()));
+
+        index.files[info.completeBaseName()].push_back(
+            {info.filePath(), size});
+    }
+
+    for (const auto & subdir : index.watched)
+        mTopDirs.insert(subdir, dir);
+
+    auto failed = mWatcher.addPaths(index.watched);
+    if (!failed.isEmpty())
+        qWarning() << "IconThemeIndex: unable to watch" << failed;
+
+    index.scanned = true;
+}
+
+void IconThemeIndex::invalidate(const QString & subdir)
+{
+    auto dir = mTopDirs.value(subdir);
+    auto pos = mIndexes.find(dir);
+    if (pos == mIndexes.end())
+        return;
+
+    // stop watching until the next lookup rescans
+    for (const auto & watched : pos->watched)
+        mTopDirs.remove(watched);
+    mWatcher.removePaths(pos->watched);
+
+    pos->watched.clear();
+    pos->files.clear();
+    pos->scanned = false;
+
+    mGenerations[dir]++;
+    mChanged(dir);
+}
+
+QString IconThemeIndex::findIcon(const QString & dir, const QString & name,
+                                 int size)
+{
+    auto pos = mIndexes.find(dir);
+    if (pos == mIndexes.end())
+        return QString();
+
+    if (!pos->scanned)
+        scan(dir, *pos);
+
+    auto files = pos->files.constFind(name);
+    if (files == pos->files.cend())
+        return QString();
+
+    // an exact match, else scalable, else the smallest larger one, else
+    // the largest one
+    const File * best = nullptr;
+    for (const auto & file : *files)
+    {
+        if (file.size == size)
+            return file.path;
+
+        if (!best)
+            best = &file;
+        else if (best->size == 0)
+            continue;
+        else if (file.size == 0)
+            best = &file;
+        else if ((file.size > size) ? (best->size < size ||
+                                       file.size < best->size)
+                                    : (best->size < file.size))
+            best = &file;
+    }
+
+    return best->path;
+}
@@ -0,0 +1,82 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef ICONTHEMEINDEX_H
+#define ICONTHEMEINDEX_H
+
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QString>
+#include <functional>
+#include <vector>
+
+// Resolves icon names against the private icon directories that items
+// may give in IconThemePath.  Each directory is scanned once into an
+// index shared by all items using it, and rescanned (lazily) after
+// inotify reports a change anywhere below it.
+class IconThemeIndex
+{
+public:
+    // called with the top-level directory whenever one changes
+    explicit IconThemeIndex(std::function<void(const QString &)> changed);
+
+    // reference-counted; the index is dropped with the last user
+    void use(const QString & dir);
+    void release(const QString & dir);
+
+    // incremented on each change, for use in cache keys
+    int generation(const QString & dir) const { return mGenerations[dir]; }
+
+    // returns the file best suited for the given size (in device
+    // pixels), or an empty string if the directory lacks the icon
+    QString findIcon(const QString & dir, const QString & name, int size);
+
+private:
+    struct File
+    {
+        QString path;
+        int size; // 0 if scalable or unknown
+    };
+
+    struct Index
+    {
+        int users = 0;
+        bool scanned = false;
+        QStringList watched;
+        QHash<QString, std::vector<File>> files;
+    };
+
+    void scan(const QString & dir, Index & index);
+    void invalidate(const QString & subdir);
+
+    std::function<void(const QString &)> mChanged;
+    QHash<QString, Index> mIndexes;
+    QHash<QString, QString> mTopDirs; // watched subdir -> top-level dir
+    QHash<QString, int> mGenerations;
+    QFileSystemWatcher mWatcher;
+};
+
+#endif // ICONTHEMEINDEX_H
@@ -31,10 +31,13 @@
 #include "statusnotifiericon.h"
 
 #include <QBoxLayout>
+#include <algorithm>
 #include <unistd.h>
 
-StatusNotifier::StatusNotifier(QWidget * parent)
-    : QWidget(parent), mLayout(this)
+StatusNotifier::StatusNotifier(Resources & res, QWidget * parent)
+    : QWidget(parent), mRes(res),
+      mIconThemeIndex([this](const QString & dir) { iconThemeChanged(dir); }),
+      mMenuPrefetch(res.settings().trayMenuPrefetch), mLayout(this)
 {
     mLayout.setContentsMargins(QMargins());
     mLayout.setSpacing(logicalDpiX() / 24);
@@ -57,23 +60,19 @@ StatusNotifier::StatusNotifier(QWidget * parent)
     connect(&mWatcher, &StatusNotifierWatcher::StatusNotifierItemUnregistered,
             this, &StatusNotifier::itemRemoved);
 
+    mBlinkTimer.setInterval(500);
+    connect(&mBlinkTimer, &QTimer::timeout, this, &StatusNotifier::blink);
+
+    // items arriving together are laid out together
+    mLayoutTimer.setSingleShot(true);
+    mLayoutTimer.setInterval(0);
+    connect(&mLayoutTimer, &QTimer::timeout, this,
+            &StatusNotifier::updateLayout);
+
     for (const auto & service : mWatcher.RegisteredStatusNotifierItems())
         itemAdded(service);
 }
 
-static void insertSorted(QBoxLayout * layout, QWidget * widget)
-{
-    int idx = 0;
-    for (; idx < layout->count(); idx++)
-    {
-        if (widget->objectName().compare(
-                layout->itemAt(idx)->widget()->objectName(),
-                Qt::CaseInsensitive) < 0)
-            break;
-    }
-    layout->insertWidget(idx, widget);
-}
-
 void StatusNotifier::itemAdded(const QString & serviceAndPath)
 {
     int slash = serviceAndPath.indexOf('/');
@@ -82,17 +81,120 @@ void StatusNotifier::itemAdded(const QString & serviceAndPath)
     auto icon = new StatusNotifierIcon(serv, path, this);
     mServices.insert(serviceAndPath, icon);
 
+    // shown once the title (needed for sorting) is known
     icon->hide();
-    icon->getPropertyAsync("Title", [this, icon](const QVariant & value) {
-        icon->setObjectName(qdbus_cast<QString>(value));
-        insertSorted(&mLayout, icon);
-        icon->show();
-    });
+}
+
+// called when the title is first known and whenever it changes
+void StatusNotifier::itemTitleChanged(StatusNotifierIcon * icon)
+{
+    removeSorted(icon);
+
+    auto key = icon->title().toCaseFolded();
+    auto pos = std::upper_bound(
+        mSorted.begin(), mSorted.end(), key,
+        [](const QString & key, const SortedItem & item) {
+            return key < item.first;
+        });
+
+    mSorted.insert(pos, {key, icon});
+    mSortKeys.insert(icon, key);
+
+    if (!mLayoutTimer.isActive())
+        mLayoutTimer.start();
+}
+
+bool StatusNotifier::takeMenuPrefetch()
+{
+    if (mMenuPrefetch <= 0)
+        return false;
+
+    mMenuPrefetch--;
+    return true;
+}
+
+void StatusNotifier::setBlinking(StatusNotifierIcon * icon, bool blinking)
+{
+    if (blinking)
+        mBlinking.insert(icon);
+    else
+        mBlinking.remove(icon);
+
+    // the timer runs only while needed
+    if (mBlinking.isEmpty())
+        mBlinkTimer.stop();
+    else if (!mBlinkTimer.isActive())
+        mBlinkTimer.start();
+}
+
+void StatusNotifier::blink()
+{
+    mBlinkState = !mBlinkState;
+    for (auto icon : mBlinking)
+        icon->blink(mBlinkState);
+}
+
+// re-renders the icons of items using a private icon directory after
+// something in it has changed
+void StatusNotifier::iconThemeChanged(const QString & dir)
+{
+    for (auto icon : std::as_const(mServices))
+    {
+        if (icon->iconThemePath() == dir)
+            icon->updateIcon();
+    }
 }
 
 void StatusNotifier::itemRemoved(const QString & serviceAndPath)
 {
     auto icon = mServices.take(serviceAndPath);
     if (icon)
+    {
+        removeSorted(icon);
+        setBlinking(icon, false);
+        mIconThemeIndex.release(icon->iconThemePath());
+        mLayout.removeWidget(icon);
         icon->deleteLater();
+    }
+}
+
+void StatusNotifier::removeSorted(StatusNotifierIcon * icon)
+{
+    auto key = mSortKeys.find(icon);
+    if (key == mSortKeys.end())
+        return;
+
+    auto range = std::equal_range(
+        mSorted.begin(), mSorted.end(), SortedItem(key.value(), nullptr),
+        [](const SortedItem & a, const SortedItem & b) {
+            return a.first < b.first;
+        });
+
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (it->second == icon)
+        {
+            mSorted.erase(it);
+            break;
+        }
+    }
+
+    mSortKeys.erase(key);
+}
+
+// moves only the widgets that are out of place
+void StatusNotifier::updateLayout()
+{
+    for (int idx = 0; idx < (int)mSorted.size(); idx++)
+    {
+        auto icon = mSorted[idx].second;
+        auto item = mLayout.itemAt(idx);
+        if (!item || item->widget() != icon)
+        {
+            mLayout.removeWidget(icon);
+            mLayout.insertWidget(idx, icon);
+        }
+
+        icon->show();
+    }
 }
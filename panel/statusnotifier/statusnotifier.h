@@ -30,24 +30,68 @@
 #ifndef STATUSNOTIFIER_H
 #define STATUSNOTIFIER_H
 
+#include "../resources.h"
+#include "../utils.h"
+#include "iconpixmap.h"
+#include "iconthemeindex.h"
 #include "statusnotifierwatcher.h"
 
 #include <QBoxLayout>
+#include <QSet>
+#include <QTimer>
 #include <QWidget>
+#include <vector>
 
 class StatusNotifierIcon;
 
 class StatusNotifier : public QWidget
 {
 public:
-    StatusNotifier(QWidget * parent = nullptr);
+    StatusNotifier(Resources & res, QWidget * parent = nullptr);
+
+    const Resources::Settings & settings() const { return mRes.settings(); }
+    void itemTitleChanged(StatusNotifierIcon * icon);
+
+    // returns true for the first few items (see TrayMenuPrefetch)
+    bool takeMenuPrefetch();
+
+    // all items needing attention blink together
+    void setBlinking(StatusNotifierIcon * icon, bool blinking);
+    bool blinkState() const { return mBlinkState; }
+
+    // rendered icons shared between items, see StatusNotifierIcon
+    using IconCache = LruCache<IconCacheKey, QPixmap, IconCacheKey::Hash>;
+    IconCache & iconCache() { return mIconCache; }
+
+    // private icon directories (IconThemePath) shared between items
+    IconThemeIndex & iconThemeIndex() { return mIconThemeIndex; }
 
 private:
     void itemAdded(const QString & serviceAndPath);
     void itemRemoved(const QString & serviceAndPath);
+    void removeSorted(StatusNotifierIcon * icon);
+    void blink();
+    void iconThemeChanged(const QString & dir);
+    void updateLayout();
 
+    Resources & mRes;
     StatusNotifierWatcher mWatcher;
     QHash<QString, StatusNotifierIcon *> mServices;
+
+    // items with a known title, sorted by case-folded title
+    using SortedItem = std::pair<QString, StatusNotifierIcon *>;
+    std::vector<SortedItem> mSorted;
+    QHash<StatusNotifierIcon *, QString> mSortKeys;
+    QTimer mLayoutTimer;
+
+    IconCache mIconCache{64};
+    IconThemeIndex mIconThemeIndex;
+    int mMenuPrefetch;
+
+    QSet<StatusNotifierIcon *> mBlinking;
+    QTimer mBlinkTimer;
+    bool mBlinkState = false;
+
     QHBoxLayout mLayout;
 };
 
@@ -30,40 +30,117 @@
 
 #include "statusnotifiericon.h"
 #include "../../dbusmenu/dbusmenuimporter.h"
+#include "../perfstats.h"
+#include "iconpixmap.h"
+#include "statusnotifier.h"
 
+#include <QCursor>
 #include <QMenu>
 #include <QMouseEvent>
+#include <QPainter>
 #include <QStyle>
-#include <QtEndian>
+#include <QToolTip>
+#include <iterator>
+#include <memory>
 
-StatusNotifierIcon::StatusNotifierIcon(QString service, QString objectPath,
-                                       QWidget * parent)
-    : QLabel(parent), mSni(service, objectPath, QDBusConnection::sessionBus())
+FetchThrottle::FetchThrottle(int minInterval, std::function<void()> fetch)
+    : mMinInterval(minInterval), mFetch(std::move(fetch))
 {
-    connect(&mSni, &org::kde::StatusNotifierItem::NewIcon, this,
-            &StatusNotifierIcon::newIcon);
-    connect(&mSni, &org::kde::StatusNotifierItem::NewToolTip, this,
-            &StatusNotifierIcon::newToolTip);
+    mTimer.setSingleShot(true);
+    QObject::connect(&mTimer, &QTimer::timeout, [this]() { start(); });
+}
 
-    getPropertyAsync("Menu", [this](const QVariant & value) {
-        auto path = qdbus_cast<QDBusObjectPath>(value);
-        if (!path.path().isEmpty())
-        {
-            auto importer =
-                new DBusMenuImporter(mSni.service(), path.path(), this);
-            mMenu = importer->menu(this);
-            connect(importer, &DBusMenuImporter::menuUpdated, this,
-                    &StatusNotifierIcon::addActivate);
-        }
-    });
+void FetchThrottle::request()
+{
+    perfCount("tray: change signals");
 
-    getPropertyAsync("Title", [this](const QVariant & value) {
-        mTitle = qdbus_cast<QString>(value);
-        addActivate();
-    });
+    // a fetch is already scheduled, so this signal adds nothing
+    if (mDirty || mTimer.isActive())
+    {
+        perfCount("tray: change signals dropped");
+        return;
+    }
+
+    // this signal will be handled along with later ones
+    if (mInFlight ||
+        (mLastFetch.isValid() && mLastFetch.elapsed() < mMinInterval))
+        perfCount("tray: change signals merged");
+
+    if (mInFlight)
+        mDirty = true;
+    else
+        schedule();
+}
+
+void FetchThrottle::finished()
+{
+    mInFlight = false;
+    if (mDirty)
+    {
+        mDirty = false;
+        schedule();
+    }
+}
 
-    newIcon();
-    newToolTip();
+void FetchThrottle::schedule()
+{
+    qint64 wait = mMinInterval;
+    if (mLastFetch.isValid())
+        wait -= mLastFetch.elapsed();
+
+    if (mLastFetch.isValid() && wait > 0)
+        mTimer.start(wait);
+    else
+        start();
+}
+
+void FetchThrottle::start()
+{
+    perfCount("tray: property fetches");
+    mInFlight = true;
+    mLastFetch.start();
+    mFetch();
+}
+
+StatusNotifierIcon::StatusNotifierIcon(QString service, QString objectPath,
+                                       StatusNotifier * host)
+    : QLabel(host), mSni(service, objectPath, QDBusConnection::sessionBus()),
+      mHost(host),
+      mIconFetch(host->settings().trayUpdateInterval,
+                 [this]() { fetchIcon("", mState.icon, mIconFetch); }),
+      mOverlayIconFetch(host->settings().trayUpdateInterval,
+                        [this]() {
+                            fetchIcon("Overlay", mState.overlayIcon,
+                                      mOverlayIconFetch);
+                        }),
+      mAttentionIconFetch(host->settings().trayUpdateInterval,
+                          [this]() {
+                              fetchIcon("Attention", mState.attentionIcon,
+                                        mAttentionIconFetch);
+                          }),
+      mToolTipFetch(host->settings().trayUpdateInterval,
+                    [this]() { fetchToolTip(); })
+{
+    connect(&mSni, &org::kde::StatusNotifierItem::NewIcon,
+            [this]() { mIconFetch.request(); });
+    connect(&mSni, &org::kde::StatusNotifierItem::NewOverlayIcon,
+            [this]() { mOverlayIconFetch.request(); });
+    connect(&mSni, &org::kde::StatusNotifierItem::NewAttentionIcon,
+            [this]() { mAttentionIconFetch.request(); });
+    connect(&mSni, &org::kde::StatusNotifierItem::NewStatus,
+            [this](const QString & status) {
+                mState.status = status;
+                updateStatus();
+            });
+    // the tooltip is re-read only when it is about to be shown
+    connect(&mSni, &org::kde::StatusNotifierItem::NewToolTip,
+            [this]() { mToolTipStale = true; });
+    connect(&mSni, &org::kde::StatusNotifierItem::NewTitle, this,
+            &StatusNotifierIcon::fetchTitle);
+
+    // one round-trip for all the initial properties
+    getAllPropertiesAsync(
+        [this](const QVariantMap & props) { loadState(props); });
 }
 
 void StatusNotifierIcon::getPropertyAsync(
@@ -86,13 +163,156 @@ void StatusNotifierIcon::getPropertyAsync(
             });
 }
 
+void StatusNotifierIcon::getAllPropertiesAsync(
+    std::function<void(const QVariantMap &)> finished)
+{
+    auto msg =
+        QDBusMessage::createMethodCall(mSni.service(), mSni.path(),
+                                       "org.freedesktop.DBus.Properties",
+                                       "GetAll");
+    msg << mSni.interface();
+    auto call = mSni.connection().asyncCall(msg);
+
+    connect(new QDBusPendingCallWatcher(call, this),
+            &QDBusPendingCallWatcher::finished,
+            [this, finished](QDBusPendingCallWatcher * cw) {
+                QDBusPendingReply<QVariantMap> reply = *cw;
+                cw->deleteLater();
+
+                // some older implementations reject GetAll
+                if (reply.isError())
+                {
+                    qDebug() << "GetAll failed (" << mSni.service() << ','
+                             << mSni.path() << "): " << reply.error()
+                             << "- falling back to Get";
+                    getPropertiesAsync(finished);
+                    return;
+                }
+
+                finished(reply.value());
+            });
+}
+
+// Reads the properties used by loadState() one by one.  Properties that
+// cannot be read are left out of the map.
+void StatusNotifierIcon::getPropertiesAsync(
+    std::function<void(const QVariantMap &)> finished)
+{
+    static const char * const names[] = {
+        "Title",
+        "Status",
+        "IconThemePath",
+        "IconName",
+        "IconPixmap",
+        "OverlayIconName",
+        "OverlayIconPixmap",
+        "AttentionIconName",
+        "AttentionIconPixmap",
+        "Menu",
+        "ToolTip",
+    };
+
+    auto props = std::make_shared<QVariantMap>();
+    auto remaining = std::make_shared<int>(std::size(names));
+
+    for (auto name : names)
+    {
+        getPropertyAsync(name, [=](const QVariant & value) {
+            if (value.isValid())
+                props->insert(name, value);
+            if (--*remaining == 0)
+                finished(*props);
+        });
+    }
+}
+
+static QString toolTipTitle(const QVariant & value)
+{
+    if (value.userType() != qMetaTypeId<QDBusArgument>())
+        return QString();
+
+    return toolTipTitle(qvariant_cast<QDBusArgument>(value));
+}
+
+void StatusNotifierIcon::loadState(const QVariantMap & props)
+{
+    mState.title = qdbus_cast<QString>(props.value("Title"));
+    mState.status = qdbus_cast<QString>(props.value("Status"));
+    mState.iconThemePath = qdbus_cast<QString>(props.value("IconThemePath"));
+    mHost->iconThemeIndex().use(mState.iconThemePath);
+
+    auto loadIcon = [&props](const QString & prefix,
+                             StatusNotifierIconData & icon) {
+        icon.name = qdbus_cast<QString>(props.value(prefix + "IconName"));
+        icon.pixmaps =
+            qdbus_cast<IconPixmapList>(props.value(prefix + "IconPixmap"));
+    };
+
+    loadIcon("", mState.icon);
+    loadIcon("Overlay", mState.overlayIcon);
+    loadIcon("Attention", mState.attentionIcon);
+    mState.menuPath = qdbus_cast<QDBusObjectPath>(props.value("Menu")).path();
+    mState.toolTip = toolTipTitle(props.value("ToolTip"));
+
+    // menus are otherwise loaded on first hover or click
+    if (!mState.menuPath.isEmpty() && mHost->takeMenuPrefetch())
+        loadMenu();
+
+    updateIcon();
+    setToolTip(mState.toolTip);
+    addActivate();
+    mHost->itemTitleChanged(this);
+}
+
+void StatusNotifierIcon::loadMenu()
+{
+    if (mMenu || mState.menuPath.isEmpty())
+        return;
+
+    // the importer fetches the menu layout as soon as it is created
+    auto importer = new DBusMenuImporter(mSni.service(), mState.menuPath, this);
+    mMenu = importer->menu(this);
+    connect(importer, &DBusMenuImporter::menuUpdated, this,
+            &StatusNotifierIcon::menuUpdated);
+    perfCount("tray: menus loaded");
+}
+
+void StatusNotifierIcon::menuUpdated(QMenu * menu)
+{
+    if (menu != mMenu)
+        return;
+
+    mMenuLoaded = true;
+    addActivate();
+
+    // the icon was clicked while the menu was loading
+    if (mPopupPending)
+    {
+        mPopupPending = false;
+        if (!mMenu->isEmpty())
+            popupMenu();
+        else
+        {
+            auto pos = mapToGlobal(QPoint()); // left top corner
+            mSni.Activate(pos.x(), pos.y());
+        }
+    }
+}
+
+void StatusNotifierIcon::popupMenu()
+{
+    auto pos = mapToGlobal(QPoint()); // left top corner
+    pos.ry() -= mMenu->sizeHint().height();
+    mMenu->popup(pos);
+}
+
 void StatusNotifierIcon::addActivate()
 {
-    if (mActivate || mTitle.isEmpty() || !mMenu || mMenu->isEmpty())
+    if (mActivate || mState.title.isEmpty() || !mMenu || mMenu->isEmpty())
         return;
 
     // use title as label for Activate action
-    mActivate = new QAction(mTitle, this);
+    mActivate = new QAction(mState.title, this);
     auto font = mActivate->font();
     font.setBold(true);
     mActivate->setFont(font);
@@ -105,56 +325,208 @@ void StatusNotifierIcon::addActivate()
     mMenu->addAction(mActivate);
 }
 
-static QIcon iconFromPixmapList(IconPixmapList & pixmaps)
+// re-reads only the properties of one icon (normal, overlay or
+// attention), trying the pixmaps only if there is no icon name
+void StatusNotifierIcon::fetchIcon(const QString & prefix,
+                                   StatusNotifierIconData & icon,
+                                   FetchThrottle & throttle)
 {
-    QIcon icon;
-    for (auto & pixmap : pixmaps)
-    {
-        int w = pixmap.width;
-        int h = pixmap.height;
+    getPropertyAsync(prefix + "IconName", [this, prefix, &icon,
+                                           &throttle](const QVariant & value) {
+        icon.name = qdbus_cast<QString>(value);
+        if (!icon.name.isEmpty())
+        {
+            icon.pixmaps.clear();
+            updateIcon();
+            throttle.finished();
+        }
+        else
+        {
+            getPropertyAsync(prefix + "IconPixmap",
+                             [this, &icon, &throttle](const QVariant & value) {
+                                 icon.pixmaps =
+                                     qdbus_cast<IconPixmapList>(value);
+                                 updateIcon();
+                                 throttle.finished();
+                             });
+        }
+    });
+}
 
-        if (pixmap.bytes.length() != w * h * 4)
-            continue;
+void StatusNotifierIcon::fetchToolTip()
+{
+    mToolTipStale = false;
+    getPropertyAsync("ToolTip", [this](const QVariant & value) {
+        mState.toolTip = toolTipTitle(value);
+        setToolTip(mState.toolTip);
+        mToolTipFetch.finished();
 
-        void * data = pixmap.bytes.data();
-        qFromBigEndian<qint32>(data, w * h, data);
-        icon.addPixmap(QPixmap::fromImage(
-            QImage((uchar *)data, w, h, QImage::Format_ARGB32)));
-    }
+        // show the tooltip that was asked for while fetching
+        if (underMouse())
+            QToolTip::showText(QCursor::pos(), mState.toolTip, this);
+    });
+}
+
+void StatusNotifierIcon::fetchTitle()
+{
+    getPropertyAsync("Title", [this](const QVariant & value) {
+        auto title = qdbus_cast<QString>(value);
+        if (title == mState.title)
+            return;
+
+        mState.title = title;
+        if (mActivate)
+            mActivate->setText(title);
+        else
+            addActivate();
+
+        mHost->itemTitleChanged(this);
+    });
+}
+
+// Renders the normal and attention icons once, so that status changes
+// and blinking only need to swap pixmaps
+void StatusNotifierIcon::updateIcon()
+{
+    mNormalPixmap = getPixmap(mState.icon, mState.overlayIcon);
+    mAttentionPixmap = getPixmap(mState.attentionIcon, mState.overlayIcon);
+    updateStatus();
+}
+
+void StatusNotifierIcon::updateStatus()
+{
+    bool attention = (mState.status == QLatin1String("NeedsAttention") &&
+                      !mAttentionPixmap.isNull());
+
+    mHost->setBlinking(this, attention);
+    blink(attention && mHost->blinkState());
+}
 
-    return icon;
+void StatusNotifierIcon::blink(bool on)
+{
+    showPixmap(on ? mAttentionPixmap : mNormalPixmap);
+}
+
+void StatusNotifierIcon::showPixmap(const QPixmap & pixmap)
+{
+    if (pixmap.cacheKey() != this->pixmap().cacheKey())
+        setPixmap(pixmap);
 }
 
-void StatusNotifierIcon::newIcon()
+// Rendered icons are cached by the host, keyed by either the icon name
+// or the raw pixmap data (and likewise for the overlay), so that an icon
+// seen before (e.g. when an item cycles through a few states) costs just
+// a lookup (see IconCacheKey).
+QPixmap StatusNotifierIcon::getPixmap(const StatusNotifierIconData & icon,
+                                      const StatusNotifierIconData & overlay)
 {
-    getPropertyAsync("IconName", [this](const QVariant & value) {
-        auto iconName = qdbus_cast<QString>(value);
-        if (!iconName.isEmpty())
+    qreal ratio = devicePixelRatioF();
+    int size = style()->pixelMetric(QStyle::PM_ButtonIconSize);
+    int deviceSize = qRound(size * ratio);
+
+    auto & themeIndex = mHost->iconThemeIndex();
+    auto & themePath = mState.iconThemePath;
+    int themeGeneration = themeIndex.generation(themePath);
+
+    // only the best-fitting pixmap is part of the key and decoded;
+    // returns false if there is no icon
+    auto iconKey = [&](const StatusNotifierIconData & icon,
+                       IconCacheKey::Source & source,
+                       const IconPixmap *& best) {
+        best = nullptr;
+        if (!icon.name.isEmpty())
         {
-            setPixmap(QIcon::fromTheme(iconName).pixmap(
-                style()->pixelMetric(QStyle::PM_ButtonIconSize)));
+            source.name = icon.name;
+            source.themePath = themePath;
+            source.themeGeneration = themeGeneration;
+            return true;
         }
-        else
+
+        best = bestIconPixmap(icon.pixmaps, deviceSize);
+        if (!best)
+            return false;
+
+        source.width = best->width;
+        source.height = best->height;
+        source.bytes = best->bytes;
+        return true;
+    };
+
+    // names are looked up in the item's own directory first
+    auto render = [&](const StatusNotifierIconData & icon,
+                      const IconPixmap * best) {
+        if (!best)
         {
-            getPropertyAsync("IconPixmap", [this](const QVariant & value) {
-                auto pixmaps = qdbus_cast<IconPixmapList>(value);
-                auto icon = iconFromPixmapList(pixmaps);
-                if (!icon.isNull())
-                {
-                    setPixmap(icon.pixmap(
-                        style()->pixelMetric(QStyle::PM_ButtonIconSize)));
-                }
-            });
+            auto file = themePath.isEmpty()
+                            ? QString()
+                            : themeIndex.findIcon(themePath, icon.name,
+                                                  deviceSize);
+            auto themeIcon =
+                file.isEmpty() ? QIcon::fromTheme(icon.name) : QIcon(file);
+            return themeIcon.pixmap(QSize(size, size), ratio);
         }
-    });
+
+        auto image = imageFromIconPixmap(*best);
+        if (image.width() > deviceSize || image.height() > deviceSize)
+            image = image.scaled(deviceSize, deviceSize, Qt::KeepAspectRatio,
+                                 Qt::SmoothTransformation);
+
+        auto pixmap = QPixmap::fromImage(std::move(image));
+        pixmap.setDevicePixelRatio(ratio);
+        return pixmap;
+    };
+
+    IconCacheKey key;
+    key.deviceSize = deviceSize;
+
+    const IconPixmap * best, * overlayBest;
+    if (!iconKey(icon, key.icon, best))
+        return QPixmap();
+
+    bool hasOverlay = iconKey(overlay, key.overlay, overlayBest);
+
+    auto & cache = mHost->iconCache();
+    if (auto cached = cache.find(key))
+    {
+        perfCount("tray: icon cache hits");
+        return *cached;
+    }
+
+    auto pixmap = render(icon, best);
+
+    // the overlay covers the bottom right quarter
+    if (hasOverlay && !pixmap.isNull())
+    {
+        auto overlayPixmap = render(overlay, overlayBest);
+        auto rect = QRectF(QPointF(), pixmap.deviceIndependentSize());
+        rect.setTopLeft(rect.center());
+
+        QPainter painter(&pixmap);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+        painter.drawPixmap(rect, overlayPixmap, overlayPixmap.rect());
+    }
+
+    perfCount("tray: icons decoded");
+    cache.insert(key, pixmap);
+    return pixmap;
 }
 
-void StatusNotifierIcon::newToolTip()
+bool StatusNotifierIcon::event(QEvent * event)
 {
-    getPropertyAsync("ToolTip", [this](const QVariant & value) {
-        auto tooltip = qdbus_cast<ToolTip>(value);
-        setToolTip(tooltip.title);
-    });
+    if (event->type() == QEvent::ToolTip && mToolTipStale)
+    {
+        mToolTipFetch.request();
+        return true;
+    }
+
+    return QLabel::event(event);
+}
+
+void StatusNotifierIcon::enterEvent(QEnterEvent * event)
+{
+    // start loading the menu in case it is clicked
+    loadMenu();
+    QLabel::enterEvent(event);
 }
 
 void StatusNotifierIcon::mousePressEvent(QMouseEvent * event)
@@ -163,11 +535,13 @@ void StatusNotifierIcon::mousePressEvent(QMouseEvent * event)
 
     if (event->button() == Qt::LeftButton)
     {
-        if (mMenu && !mMenu->isEmpty())
+        if (!mState.menuPath.isEmpty() && !mMenuLoaded)
         {
-            pos.ry() -= mMenu->sizeHint().height();
-            mMenu->popup(pos);
+            loadMenu();
+            mPopupPending = true;
         }
+        else if (mMenu && !mMenu->isEmpty())
+            popupMenu();
         else
             mSni.Activate(pos.x(), pos.y());
     }
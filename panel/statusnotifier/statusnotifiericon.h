@@ -32,33 +32,118 @@
 
 #include "statusnotifieriteminterface.h"
 
+#include <QElapsedTimer>
 #include <QLabel>
 #include <QPointer>
+#include <QTimer>
 #include <functional>
 
 class QMenu;
+class StatusNotifier;
+
+// Coalesces change signals for one property (or group of properties).
+// At most one fetch is in flight; signals arriving meanwhile result in
+// a single re-fetch once it completes.  Fetches are started at least
+// minInterval msecs apart.
+class FetchThrottle
+{
+public:
+    FetchThrottle(int minInterval, std::function<void()> fetch);
+
+    void request();
+    void finished();
+
+private:
+    void schedule();
+    void start();
+
+    const int mMinInterval;
+    const std::function<void()> mFetch;
+    QElapsedTimer mLastFetch;
+    QTimer mTimer;
+    bool mInFlight = false;
+    bool mDirty = false;
+};
+
+// An icon is given either by name or as a list of pixmaps
+struct StatusNotifierIconData
+{
+    QString name;
+    IconPixmapList pixmaps;
+};
+
+// Cached copy of an item's properties, read all at once by GetAll and
+// then updated field by field as change signals arrive
+struct StatusNotifierItemState
+{
+    QString title;
+    QString status;
+    QString iconThemePath;
+    StatusNotifierIconData icon;
+    StatusNotifierIconData overlayIcon;
+    StatusNotifierIconData attentionIcon;
+    QString menuPath;
+    QString toolTip;
+};
 
 class StatusNotifierIcon : public QLabel
 {
 public:
     StatusNotifierIcon(QString service, QString objectPath,
-                       QWidget * parent = nullptr);
+                       StatusNotifier * host);
+
+    const QString & title() const { return mState.title; }
+    const QString & iconThemePath() const { return mState.iconThemePath; }
 
+    // re-renders the normal and attention icons
+    void updateIcon();
+
+    // called by the host's blink timer while the item needs attention
+    void blink(bool on);
+
+private:
     void getPropertyAsync(QString const & name,
                           std::function<void(const QVariant &)> finished);
+    void getPropertiesAsync(
+        std::function<void(const QVariantMap &)> finished);
+    void getAllPropertiesAsync(
+        std::function<void(const QVariantMap &)> finished);
 
-private:
+    void loadState(const QVariantMap & props);
+    void loadMenu();
+    void menuUpdated(QMenu * menu);
+    void popupMenu();
     void addActivate();
-    void newIcon();
-    void newToolTip();
+    void fetchIcon(const QString & prefix, StatusNotifierIconData & icon,
+                   FetchThrottle & throttle);
+    void fetchToolTip();
+    void fetchTitle();
+    void updateStatus();
+    void showPixmap(const QPixmap & pixmap);
+    QPixmap getPixmap(const StatusNotifierIconData & icon,
+                      const StatusNotifierIconData & overlay);
 
     org::kde::StatusNotifierItem mSni;
-    QString mTitle;
+    StatusNotifier * const mHost;
+    StatusNotifierItemState mState;
+    FetchThrottle mIconFetch;
+    FetchThrottle mOverlayIconFetch;
+    FetchThrottle mAttentionIconFetch;
+    FetchThrottle mToolTipFetch;
+    bool mToolTipStale = false;
     QPointer<QMenu> mMenu;
     QPointer<QAction> mActivate;
+    bool mMenuLoaded = false;
+    bool mPopupPending = false;
+
+    // pre-rendered, including any overlay
+    QPixmap mNormalPixmap;
+    QPixmap mAttentionPixmap;
 
 protected:
-    void mousePressEvent(QMouseEvent * event);
+    bool event(QEvent * event) override;
+    void enterEvent(QEnterEvent * event) override;
+    void mousePressEvent(QMouseEvent * event) override;
 };
 
 #endif // STATUSNOTIFIERICON_H
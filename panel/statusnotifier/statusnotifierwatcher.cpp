@@ -27,6 +27,7 @@
 
 #include "statusnotifierwatcher.h"
 #include <QDBusConnectionInterface>
+#include <QDBusPendingCallWatcher>
 
 StatusNotifierWatcher::StatusNotifierWatcher(QObject * parent) : QObject(parent)
 {
@@ -75,6 +76,18 @@ StatusNotifierWatcher::~StatusNotifierWatcher()
         "org.kde.StatusNotifierWatcher");
 }
 
+QStringList StatusNotifierWatcher::RegisteredStatusNotifierItems() const
+{
+    QStringList items;
+    for (auto it = mItems.cbegin(); it != mItems.cend(); ++it)
+    {
+        for (auto & path : it.value())
+            items.append(it.key() + path);
+    }
+
+    return items;
+}
+
 void StatusNotifierWatcher::RegisterStatusNotifierItem(
     const QString & serviceOrPath)
 {
@@ -88,23 +101,54 @@ void StatusNotifierWatcher::RegisterStatusNotifierItem(
         service = message().service();
     }
 
-    QString notifierItemId = service + path;
+    // the caller's own unique name is registered by definition
+    if (service == message().service())
+    {
+        addItem(service, path);
+        return;
+    }
+
+    // Otherwise, look up the unique name of the service's owner without
+    // blocking (this also checks that the service exists), so that an
+    // item registered under both its well-known and unique names is
+    // added only once.  The reply to the caller is sent once the lookup
+    // is done.
     auto dbus = QDBusConnection::sessionBus();
-    auto reply = dbus.interface()->isServiceRegistered(service);
+    auto msg = message();
+    setDelayedReply(true);
+
+    auto call = dbus.interface()->asyncCall("GetNameOwner", service);
+    connect(new QDBusPendingCallWatcher(call, this),
+            &QDBusPendingCallWatcher::finished,
+            [this, dbus, msg, path](QDBusPendingCallWatcher * cw) {
+                QDBusPendingReply<QString> reply = *cw;
+                if (reply.isValid() && !reply.value().isEmpty())
+                    addItem(reply.value(), path);
+
+                dbus.send(msg.createReply());
+                cw->deleteLater();
+            });
+}
 
-    if (reply.value() && !mServices.contains(notifierItemId))
-    {
-        mServices << notifierItemId;
+void StatusNotifierWatcher::addItem(const QString & service,
+                                    const QString & path)
+{
+    auto & paths = mItems[service];
+    if (paths.contains(path))
+        return;
+
+    if (paths.isEmpty())
         mWatcher->addWatchedService(service);
-        emit StatusNotifierItemRegistered(notifierItemId);
-    }
+
+    paths.append(path);
+    emit StatusNotifierItemRegistered(service + path);
 }
 
 void StatusNotifierWatcher::RegisterStatusNotifierHost(const QString & service)
 {
     if (!mHosts.contains(service))
     {
-        mHosts.append(service);
+        mHosts.insert(service);
         mWatcher->addWatchedService(service);
     }
 }
@@ -113,23 +157,9 @@ void StatusNotifierWatcher::serviceUnregistered(const QString & service)
 {
     mWatcher->removeWatchedService(service);
 
-    if (mHosts.contains(service))
-    {
-        mHosts.removeAll(service);
+    if (mHosts.remove(service))
         return;
-    }
 
-    QString match = service + QLatin1Char('/');
-    QStringList::Iterator it = mServices.begin();
-    while (it != mServices.end())
-    {
-        if (it->startsWith(match))
-        {
-            QString name = *it;
-            it = mServices.erase(it);
-            emit StatusNotifierItemUnregistered(name);
-        }
-        else
-            ++it;
-    }
+    for (auto & path : mItems.take(service))
+        emit StatusNotifierItemUnregistered(service + path);
 }
@@ -33,6 +33,8 @@
 #include <QDBusMessage>
 #include <QDBusMetaType>
 #include <QDBusServiceWatcher>
+#include <QHash>
+#include <QSet>
 
 #include "dbustypes.h"
 
@@ -54,7 +56,7 @@ public:
 
     bool isStatusNotifierHostRegistered() { return mHosts.count() > 0; }
     int protocolVersion() const { return 0; }
-    QStringList RegisteredStatusNotifierItems() const { return mServices; }
+    QStringList RegisteredStatusNotifierItems() const;
 
 signals:
     Q_SCRIPTABLE void StatusNotifierItemRegistered(const QString & service);
@@ -68,8 +70,11 @@ public slots:
     void serviceUnregistered(const QString & service);
 
 private:
-    QStringList mServices;
-    QStringList mHosts;
+    void addItem(const QString & service, const QString & path);
+
+    // registered item paths, keyed by unique bus name
+    QHash<QString, QStringList> mItems;
+    QSet<QString> mHosts;
     QDBusServiceWatcher * mWatcher;
 };
 
@@ -30,39 +30,128 @@
  * END_COMMON_COPYRIGHT_HEADER */
 
 #include "taskbar.h"
+#include "perfstats.h"
+#include "resources.h"
 #include "taskbutton.h"
 #include "wlr-foreign-toplevel-management-unstable-v1.h"
 
 #include <KWindowInfo>
 #include <KX11Extras>
 #include <QGuiApplication>
+#include <QScreen>
+#include <QStyle>
+#include <QWheelEvent>
+#include <QWindow>
 #include <private/qtx11extras_p.h>
 
-TaskBar::TaskBar(Resources & res, QWidget * parent)
-    : QWidget(parent), mRes(res), mLayout(this)
+static zwlr_foreign_toplevel_handle_v1 * toHandle(WId window)
+{
+    return reinterpret_cast<zwlr_foreign_toplevel_handle_v1 *>(window);
+}
+
+static WId toWindow(zwlr_foreign_toplevel_handle_v1 * handle)
+{
+    return reinterpret_cast<WId>(handle);
+}
+
+static void releaseOutput(wl_output * output)
 {
-    mLayout.setContentsMargins(QMargins());
-    mLayout.setSpacing(0);
-    mLayout.addStretch(1);
+    if (wl_output_get_version(output) >= WL_OUTPUT_RELEASE_SINCE_VERSION)
+        wl_output_release(output);
+    else
+        wl_output_destroy(output);
+}
 
+TaskBar::TaskBar(Resources & res, QWidget * parent)
+    : QWidget(parent), mRes(res), mScrollLeft(this), mScrollRight(this),
+      mOverflowButton(this)
+{
     setAcceptDrops(true);
 
+    mClock.start();
+    mRealizeTimer.setSingleShot(true);
+    connect(&mRealizeTimer, &QTimer::timeout, this, &TaskBar::realizeTasks);
+
+    // Layout and property changes are coalesced and applied at most
+    // once per display frame
+    int frameRate = qRound(QGuiApplication::primaryScreen()->refreshRate());
+    int frameInterval = 1000 / qMax(frameRate, 1);
+
+    mLayoutTimer.setSingleShot(true);
+    mLayoutTimer.setInterval(frameInterval);
+    connect(&mLayoutTimer, &QTimer::timeout, this, &TaskBar::updateLayout);
+
+    mScrollLeft.setArrowType(Qt::LeftArrow);
+    mScrollRight.setArrowType(Qt::RightArrow);
+    mScrollLeft.setAutoRaise(true);
+    mScrollRight.setAutoRaise(true);
+    mScrollLeft.hide();
+    mScrollRight.hide();
+    connect(&mScrollLeft, &QToolButton::clicked, [this]() { scrollBy(-1); });
+    connect(&mScrollRight, &QToolButton::clicked, [this]() { scrollBy(1); });
+
+    // the menu lists all tasks but is only filled in when opened
+    mOverflowButton.setArrowType(Qt::DownArrow);
+    mOverflowButton.setAutoRaise(true);
+    mOverflowButton.setPopupMode(QToolButton::InstantPopup);
+    mOverflowButton.setMenu(&mOverflowMenu);
+    mOverflowButton.hide();
+    connect(&mOverflowMenu, &QMenu::aboutToShow, this,
+            &TaskBar::buildOverflowMenu);
+
+    mDragTimer.setSingleShot(true);
+    mDragTimer.setInterval(500);
+    connect(&mDragTimer, &QTimer::timeout,
+            [this]() { activateTask(mDragWindow); });
+
+    updateMetrics();
+
     if (QX11Info::isPlatformX11())
     {
+        int rate = res.settings().taskBarUpdateRate;
+        mFlushTimer.setSingleShot(true);
+        mFlushTimer.setInterval((rate > 0) ? 1000 / rate : frameInterval);
+        connect(&mFlushTimer, &QTimer::timeout, this,
+                &TaskBar::flushDirtyWindows);
+
+        if (res.settings().taskBarEventFilter)
+        {
+            mPropertyFilter = std::make_unique<X11PropertyFilter>(
+                [this](WId window, xcb_atom_t atom) {
+                    onPropertyChanged(window, atom);
+                });
+        }
+
+        mModel.setActiveWindow(KX11Extras::activeWindow());
+
         for (auto window : KX11Extras::stackingOrder())
         {
-            if (acceptWindow(window))
-                addWindow(window);
+            // select events before reading any properties
+            if (mPropertyFilter)
+                mPropertyFilter->selectWindow(window);
+
+            markDirty(window, DirtyAccept);
         }
 
         connect(KX11Extras::self(), &KX11Extras::windowAdded, this,
                 &TaskBar::onWindowAdded);
         connect(KX11Extras::self(), &KX11Extras::windowRemoved, this,
-                &TaskBar::removeWindow);
+                &TaskBar::onWindowRemoved);
         connect(KX11Extras::self(), &KX11Extras::activeWindowChanged, this,
                 &TaskBar::onActiveWindowChanged);
-        connect(KX11Extras::self(), &KX11Extras::windowChanged, this,
-                &TaskBar::onWindowChanged);
+
+        // Note: connecting to windowChanged makes KWindowSystem track
+        // properties of all windows (see KX11Extras::connectNotify)
+        if (!mPropertyFilter)
+        {
+            connect(KX11Extras::self(), &KX11Extras::windowChanged, this,
+                    &TaskBar::onWindowChanged);
+
+            // the filter must be installed after KWindowSystem's own
+            if (perfStatsEnabled())
+                mKWinRequests = std::make_unique<X11EventRequestCounter>(
+                    "taskbar: X11 requests (KWindowSystem)");
+        }
     }
 
     auto waylandApp =
@@ -78,19 +167,450 @@ TaskBar::TaskBar(Resources & res, QWidget * parent)
                             interface,
                             zwlr_foreign_toplevel_manager_v1_interface.name))
                         self->addToplevelManager(registry, name, version);
+                    else if (!strcmp(interface, wl_output_interface.name))
+                        self->addOutput(registry, name, version);
                 },
-            .global_remove = [](void * data, wl_registry * registry,
-                                uint32_t name) { /* no-op */ }};
+            .global_remove =
+                [](void * data, wl_registry * registry, uint32_t name) {
+                    static_cast<TaskBar *>(data)->removeGlobal(name);
+                }};
+
+        mRegistry = wl_display_get_registry(waylandApp->display());
+        wl_registry_add_listener(mRegistry, &registry_listener_impl, this);
+    }
+}
+
+TaskBar::~TaskBar()
+{
+    if (!QX11Info::isPlatformX11())
+    {
+        // the connection is about to be closed, so there is no point
+        // in waiting for "finished" events
+        if (mManager)
+        {
+            zwlr_foreign_toplevel_manager_v1_stop(mManager);
+            finishToplevelManager(mManager);
+        }
+
+        while (!mStoppedManagers.empty())
+            finishToplevelManager(mStoppedManagers.back());
+
+        for (auto & [output, info] : mOutputs)
+            releaseOutput(output);
+        if (mRegistry)
+            wl_registry_destroy(mRegistry);
+
+        auto waylandApp =
+            qGuiApp->nativeInterface<QNativeInterface::QWaylandApplication>();
+        if (waylandApp)
+            wl_display_flush(waylandApp->display());
+    }
+}
+
+void TaskBar::activateTask(WId window)
+{
+    if (!window)
+        return;
+
+    if (QX11Info::isPlatformX11())
+    {
+        KX11Extras::forceActiveWindow(window);
+        // need to flush if called from timer
+        xcb_flush(QX11Info::connection());
+    }
+    else
+    {
+        auto waylandApp =
+            qGuiApp->nativeInterface<QNativeInterface::QWaylandApplication>();
+        zwlr_foreign_toplevel_handle_v1_unset_minimized(toHandle(window));
+        zwlr_foreign_toplevel_handle_v1_activate(
+            toHandle(topmostChild(window)), waylandApp->seat());
+    }
+}
+
+void TaskBar::minimizeTask(WId window)
+{
+    if (!window)
+        return;
+
+    if (QX11Info::isPlatformX11())
+        KX11Extras::minimizeWindow(window);
+    else
+        zwlr_foreign_toplevel_handle_v1_set_minimized(toHandle(window));
+}
+
+void TaskBar::closeTask(WId window)
+{
+    if (!window)
+        return;
+
+    if (QX11Info::isPlatformX11())
+    {
+        NETRootInfo info(QX11Info::connection(), NET::CloseWindow);
+        info.closeWindowRequest(window);
+    }
+    else
+        zwlr_foreign_toplevel_handle_v1_close(toHandle(window));
+}
+
+void TaskBar::startDragActivate(WId window)
+{
+    mDragWindow = window;
+    mDragTimer.start();
+}
+
+void TaskBar::stopDragActivate()
+{
+    mDragWindow = 0;
+    mDragTimer.stop();
+}
+
+void TaskBar::addTask(WId window)
+{
+    auto & task = mModel.add(window);
+    task.addedAt = mClock.elapsed();
+
+    if (!mRealizeTimer.isActive())
+        mRealizeTimer.start(GracePeriod);
+}
+
+// X11-specific: drops requests for a window that is no longer a task
+template<class Request>
+static void discardRequests(std::vector<std::pair<WId, Request>> & pending,
+                            WId window)
+{
+    for (auto iter = pending.begin(); iter != pending.end();)
+    {
+        if (iter->first == window)
+        {
+            iter->second.discard();
+            iter = pending.erase(iter);
+        }
+        else
+            iter++;
+    }
+}
+
+void TaskBar::removeTask(WId window)
+{
+    // the window may also just have been rejected by acceptWindow()
+    mIconHeaders.erase(window);
+    discardRequests(mPendingTitles, window);
+    discardRequests(mPendingClasses, window);
+    discardRequests(mPendingIcons, window);
+
+    auto task = mModel.find(window);
+    if (!task)
+        return;
+
+    if (mActiveTask == window)
+        mActiveTask = 0;
+    if (mDragWindow == window)
+        stopDragActivate();
+
+    if (task->flags & TaskWindow::Ready)
+        scheduleLayout();
+
+    releaseButton(*task);
+    mModel.remove(window);
+}
+
+void TaskBar::setTaskTitle(TaskWindow & task, const QString & title)
+{
+    task.title = title;
+    if (task.button)
+        task.button->setTitle(title);
+}
+
+void TaskBar::setTaskIcon(TaskWindow & task, const QIcon & icon)
+{
+    task.icon = icon;
+    if (task.button)
+        task.button->updateIcon(icon);
+}
+
+// only the previously and newly active buttons are touched
+void TaskBar::setActiveTask(WId window)
+{
+    if (auto prev = mModel.find(mActiveTask); prev && mActiveTask != window)
+    {
+        prev->flags &= ~TaskWindow::Active;
+        if (prev->button)
+            prev->button->setChecked(false);
+    }
+
+    auto task = mModel.find(window);
+    if (task)
+    {
+        task->flags |= TaskWindow::Active;
+        if (task->button)
+            task->button->setChecked(true);
+    }
+
+    mActiveTask = task ? window : 0;
+}
+
+// Marks tasks older than the grace period as ready to be shown
+void TaskBar::realizeTasks()
+{
+    qint64 now = mClock.elapsed();
+    qint64 nextDue = -1;
+    bool added = false;
+
+    for (auto & task : mModel)
+    {
+        if (task.flags & TaskWindow::Ready)
+            continue;
+
+        qint64 due = task.addedAt + GracePeriod;
+        if (due > now)
+        {
+            if (nextDue < 0 || due < nextDue)
+                nextDue = due;
+            continue;
+        }
 
-        wl_registry_add_listener(wl_display_get_registry(waylandApp->display()),
-                                 &registry_listener_impl, this);
-        // TODO: cleanup listener at exit?
+        task.flags |= TaskWindow::Ready;
+        added = true;
+    }
+
+    // buttons are created (or re-used) by the next layout pass
+    if (added)
+        scheduleLayout();
+    if (nextDue >= 0)
+        mRealizeTimer.start(nextDue - now);
+}
+
+void TaskBar::acquireButton(TaskWindow & task)
+{
+    if (task.button)
+        return;
+
+    if (!mSpareButtons.empty())
+    {
+        task.button = mSpareButtons.back();
+        mSpareButtons.pop_back();
+    }
+    else
+        task.button = new TaskButton(this);
+
+    task.button->bind(task);
+}
+
+void TaskBar::releaseButton(TaskWindow & task)
+{
+    auto button = task.button;
+    if (!button)
+        return;
+
+    task.button = nullptr;
+    button->unbind();
+    button->hide();
+
+    if ((int)mSpareButtons.size() < MaxSpareButtons)
+    {
+        button->setChecked(false);
+        mSpareButtons.push_back(button);
+    }
+    else
+        button->deleteLater();
+}
+
+QSize TaskBar::sizeHint() const
+{
+    // the width is whatever is left over in the panel
+    return {0, mButtonHeight};
+}
+
+QSize TaskBar::minimumSizeHint() const { return {0, mButtonHeight}; }
+
+void TaskBar::changeEvent(QEvent * event)
+{
+    if (event->type() == QEvent::StyleChange ||
+        event->type() == QEvent::FontChange)
+        updateMetrics();
+
+    QWidget::changeEvent(event);
+}
+
+void TaskBar::resizeEvent(QResizeEvent * event)
+{
+    updateLayout();
+    QWidget::resizeEvent(event);
+}
+
+void TaskBar::showEvent(QShowEvent * event)
+{
+    // the window handle exists once the panel is shown
+    auto handle = window()->windowHandle();
+    if (handle && !QX11Info::isPlatformX11() &&
+        mRes.settings().taskBarScreenOnly)
+        connect(handle, &QWindow::screenChanged, this,
+                &TaskBar::updateToplevels, Qt::UniqueConnection);
+
+    QWidget::showEvent(event);
+}
+
+void TaskBar::wheelEvent(QWheelEvent * event)
+{
+    int delta = event->angleDelta().y();
+    if (delta)
+        scrollBy((delta > 0) ? -1 : 1);
+
+    event->accept();
+}
+
+// Measures a sample button once, so that layout does not need to query
+// size hints from each button
+void TaskBar::updateMetrics()
+{
+    QToolButton sample;
+    sample.setFont(font());
+    sample.setToolButtonStyle(Qt::ToolButtonTextBesideIcon);
+    sample.setIcon(style()->standardIcon(QStyle::SP_FileIcon));
+    sample.setText("X");
+
+    int height = sample.sizeHint().height();
+    int dpi = logicalDpiX();
+
+    mMaxButtonWidth = 2 * dpi;
+    mMinButtonWidth = qMin(3 * dpi / 4, mMaxButtonWidth);
+    mArrowWidth = mScrollLeft.sizeHint().width();
+
+    if (height != mButtonHeight)
+    {
+        mButtonHeight = height;
+        updateGeometry();
+    }
+
+    scheduleLayout();
+}
+
+void TaskBar::scheduleLayout()
+{
+    if (!mLayoutTimer.isActive())
+        mLayoutTimer.start();
+}
+
+// Positions all buttons in a single pass.  Buttons shrink to share the
+// available width, down to a minimum; beyond that, only the buttons that
+// fit exist as widgets, and the rest are reached by scrolling or through
+// the overflow menu.
+void TaskBar::updateLayout()
+{
+    PerfTimer timer("taskbar: layout pass");
+    mLayoutTimer.stop();
+
+    int count = 0;
+    for (auto & task : mModel)
+    {
+        if (task.flags & TaskWindow::Ready)
+            count++;
+    }
+
+    int avail = width();
+    int h = height();
+    int buttonWidth = mMaxButtonWidth;
+    if (count * buttonWidth > avail)
+        buttonWidth = qMax(avail / qMax(count, 1), mMinButtonWidth);
+
+    int first = 0, shown = count, x = 0;
+    bool overflow = (count * buttonWidth > avail);
+    if (overflow)
+    {
+        shown = qMax((avail - 3 * mArrowWidth) / buttonWidth, 1);
+        mScrollPos = qBound(0, mScrollPos, count - shown);
+        first = mScrollPos;
+        x = mArrowWidth;
+
+        mScrollLeft.setGeometry(0, 0, mArrowWidth, h);
+        mScrollRight.setGeometry(avail - 2 * mArrowWidth, 0, mArrowWidth, h);
+        mOverflowButton.setGeometry(avail - mArrowWidth, 0, mArrowWidth, h);
+        mScrollLeft.setEnabled(first > 0);
+        mScrollRight.setEnabled(first + shown < count);
+    }
+    else
+        mScrollPos = 0;
+
+    mScrollLeft.setVisible(overflow);
+    mScrollRight.setVisible(overflow);
+    mOverflowButton.setVisible(overflow);
+
+    // release buttons scrolled out of view first, so that the pool
+    // can supply the ones scrolled into view
+    int idx = 0;
+    for (auto & task : mModel)
+    {
+        if (!(task.flags & TaskWindow::Ready))
+            continue;
+        if (idx < first || idx >= first + shown)
+            releaseButton(task);
+        idx++;
+    }
+
+    idx = 0;
+    for (auto & task : mModel)
+    {
+        if (!(task.flags & TaskWindow::Ready))
+            continue;
+
+        if (idx >= first && idx < first + shown)
+        {
+            acquireButton(task);
+            task.button->setGeometry(x + (idx - first) * buttonWidth, 0,
+                                     buttonWidth, h);
+            task.button->show();
+        }
+
+        idx++;
+    }
+}
+
+void TaskBar::scrollBy(int buttons)
+{
+    if (!mScrollLeft.isVisible())
+        return;
+
+    mScrollPos += buttons;
+    updateLayout();
+}
+
+void TaskBar::buildOverflowMenu()
+{
+    mOverflowMenu.clear();
+
+    int maxWidth = 4 * logicalDpiX();
+    auto metrics = mOverflowMenu.fontMetrics();
+
+    for (auto & task : mModel)
+    {
+        if (!(task.flags & TaskWindow::Ready))
+            continue;
+
+        auto text = metrics.elidedText(task.title, Qt::ElideRight, maxWidth);
+        auto action =
+            mOverflowMenu.addAction(task.icon, text.replace("&", "&&"));
+        action->setCheckable(true);
+        action->setChecked(task.flags & TaskWindow::Active);
+
+        // the window may be gone by the time the action is triggered
+        WId window = task.id;
+        connect(action, &QAction::triggered, [this, window]() {
+            if (mModel.contains(window))
+                activateTask(window);
+        });
     }
 }
 
 void TaskBar::addToplevelManager(wl_registry * registry, uint32_t name,
                                  uint32_t version)
 {
+    if (mManager)
+    {
+        qWarning() << "Ignoring duplicate zwlr_foreign_toplevel_manager_v1";
+        return;
+    }
+
     version = std::min<uint32_t>(
         version, zwlr_foreign_toplevel_manager_v1_interface.version);
     auto manager = static_cast<zwlr_foreign_toplevel_manager_v1 *>(
@@ -108,116 +628,683 @@ void TaskBar::addToplevelManager(wl_registry * registry, uint32_t name,
             .toplevel =
                 [](void * data, zwlr_foreign_toplevel_manager_v1 * manager,
                    zwlr_foreign_toplevel_handle_v1 * handle) {
-                    static_cast<TaskBar *>(data)->addWindow(handle);
+                    static_cast<TaskBar *>(data)->addWindow(manager, handle);
                 },
             .finished =
                 [](void * data, zwlr_foreign_toplevel_manager_v1 * manager) {
-                    /* no-op */
+                    auto self = static_cast<TaskBar *>(data);
+                    self->finishToplevelManager(manager);
                 },
         };
 
     zwlr_foreign_toplevel_manager_v1_add_listener(manager,
                                                   &toplevel_manager_impl, this);
-    // TODO: cleanup listener at exit?
+    mManager = manager;
+    mManagerGlobal = name;
 }
 
-void TaskBar::addWindow(zwlr_foreign_toplevel_handle_v1 * handle)
+// Asks the compositor to stop sending toplevel events.  Events may
+// still be in flight (even new toplevels), so the manager and its
+// handles are kept until the "finished" event.  Meanwhile, they are no
+// longer shown (see applyToplevel).
+void TaskBar::stopToplevelManager()
 {
-    auto button = new TaskButtonWayland(mRes, handle, this);
-    mLayout.insertWidget(mLayout.count() - 1, button);
+    if (!mManager)
+        return;
+
+    zwlr_foreign_toplevel_manager_v1_stop(mManager);
+    mStoppedManagers.push_back(mManager);
+    mManager = nullptr;
+    mManagerGlobal = 0;
+
+    updateToplevels();
 }
 
-bool TaskBar::acceptWindow(WId window) const
+// Destroys a manager and all its toplevel handles.  The compositor sends
+// no more events after "finished" and destroys the manager on its side.
+void TaskBar::finishToplevelManager(zwlr_foreign_toplevel_manager_v1 * manager)
 {
-    const NET::WindowTypes ignoreList =
-        NET::DesktopMask | NET::DockMask | NET::SplashMask | NET::ToolbarMask |
-        NET::MenuMask | NET::PopupMenuMask | NET::NotificationMask;
+    for (auto iter = mToplevels.begin(); iter != mToplevels.end();)
+    {
+        if (iter->second.manager != manager)
+        {
+            iter++;
+            continue;
+        }
 
-    KWindowInfo info(window, NET::WMWindowType | NET::WMState,
-                     NET::WM2TransientFor);
+        removeTask(iter->first);
+        zwlr_foreign_toplevel_handle_v1_destroy(toHandle(iter->first));
+        perfCount("taskbar: Wayland handles destroyed");
+        iter = mToplevels.erase(iter);
+    }
 
-    if (!info.valid() ||
-        NET::typeMatchesMask(info.windowType(NET::AllTypesMask), ignoreList) ||
-        (info.state() & NET::SkipTaskbar))
+    zwlr_foreign_toplevel_manager_v1_destroy(manager);
+
+    if (manager == mManager)
     {
-        return false;
+        mManager = nullptr;
+        mManagerGlobal = 0;
     }
+    else
+        mStoppedManagers.erase(std::remove(mStoppedManagers.begin(),
+                                           mStoppedManagers.end(), manager),
+                               mStoppedManagers.end());
+}
 
-    WId transFor = info.transientFor();
-    if (transFor == 0 || transFor == window ||
-        transFor == (WId)QX11Info::appRootWindow())
+void TaskBar::addOutput(wl_registry * registry, uint32_t name,
+                        uint32_t version)
+{
+    // the output name is only available in version 4
+    version = std::min<uint32_t>(version, 4);
+    auto output = static_cast<wl_output *>(
+        wl_registry_bind(registry, name, &wl_output_interface, version));
+    if (!output)
     {
-        return true;
+        qWarning() << "Could not bind wl_output_interface";
+        return;
     }
 
-    return false;
+    static const wl_output_listener output_impl = {
+        .geometry = [](void * data, wl_output * output, int32_t x, int32_t y,
+                       int32_t physical_width, int32_t physical_height,
+                       int32_t subpixel, const char * make, const char * model,
+                       int32_t transform) { /* no-op */ },
+        .mode = [](void * data, wl_output * output, uint32_t flags,
+                   int32_t width, int32_t height,
+                   int32_t refresh) { /* no-op */ },
+        .done =
+            [](void * data, wl_output * output) {
+                auto self = static_cast<TaskBar *>(data);
+                if (self->mRes.settings().taskBarScreenOnly)
+                    self->updateToplevels();
+            },
+        .scale = [](void * data, wl_output * output,
+                    int32_t factor) { /* no-op */ },
+        .name =
+            [](void * data, wl_output * output, const char * name) {
+                static_cast<TaskBar *>(data)->mOutputs[output].name = name;
+            },
+        .description = [](void * data, wl_output * output,
+                          const char * description) { /* no-op */ },
+    };
+
+    mOutputs[output] = {name, QString()};
+    wl_output_add_listener(output, &output_impl, this);
 }
 
-void TaskBar::addWindow(WId window)
+void TaskBar::removeGlobal(uint32_t name)
 {
-    if (mKnownWindows.find(window) == mKnownWindows.end())
+    if (mManager && name == mManagerGlobal)
     {
-        auto button = new TaskButtonX11(window, this);
-        mLayout.insertWidget(mLayout.count() - 1, button);
-        mKnownWindows[window] = button;
+        stopToplevelManager();
+        return;
+    }
+
+    for (auto iter = mOutputs.begin(); iter != mOutputs.end(); iter++)
+    {
+        if (iter->second.global != name)
+            continue;
+
+        auto output = iter->first;
+        for (auto & [window, toplevel] : mToplevels)
+        {
+            auto & outputs = toplevel.outputs;
+            outputs.erase(std::remove(outputs.begin(), outputs.end(), output),
+                          outputs.end());
+        }
+
+        mOutputs.erase(iter);
+        releaseOutput(output);
+
+        if (mRes.settings().taskBarScreenOnly)
+            updateToplevels();
+        return;
     }
 }
 
-void TaskBar::removeWindow(WId window)
+void TaskBar::addWindow(zwlr_foreign_toplevel_manager_v1 * manager,
+                        zwlr_foreign_toplevel_handle_v1 * handle)
 {
-    auto pos = mKnownWindows.find(window);
-    if (pos != mKnownWindows.end())
+    PerfTimer timer("taskbar: Wayland toplevel added");
+    static const zwlr_foreign_toplevel_handle_v1_listener toplevel_handle_impl =
+        {
+            .title =
+                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle,
+                   const char * title) {
+                    auto self = static_cast<TaskBar *>(data);
+                    self->mToplevels[toWindow(handle)].pendingTitle = title;
+                },
+            .app_id =
+                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle,
+                   const char * app_id) {
+                    auto self = static_cast<TaskBar *>(data);
+                    self->mToplevels[toWindow(handle)].pendingAppId = app_id;
+                },
+            .output_enter =
+                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle,
+                   wl_output * output) {
+                    auto self = static_cast<TaskBar *>(data);
+                    auto & outputs = self->mToplevels[toWindow(handle)].outputs;
+                    if (std::find(outputs.begin(), outputs.end(), output) ==
+                        outputs.end())
+                        outputs.push_back(output);
+                },
+            .output_leave =
+                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle,
+                   wl_output * output) {
+                    auto self = static_cast<TaskBar *>(data);
+                    auto & outputs = self->mToplevels[toWindow(handle)].outputs;
+                    outputs.erase(
+                        std::remove(outputs.begin(), outputs.end(), output),
+                        outputs.end());
+                },
+            .state =
+                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle,
+                   wl_array * state) {
+                    auto self = static_cast<TaskBar *>(data);
+                    auto start = static_cast<const uint32_t *>(state->data);
+                    auto end = start + (state->size / sizeof(uint32_t));
+                    self->mToplevels[toWindow(handle)].pendingActivated =
+                        (std::find(
+                             start, end,
+                             ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED) !=
+                         end);
+                },
+            .done =
+                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle) {
+                    auto self = static_cast<TaskBar *>(data);
+                    self->mToplevels[toWindow(handle)].done = true;
+                    self->applyToplevel(handle);
+                },
+            .closed =
+                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle) {
+                    static_cast<TaskBar *>(data)->removeWindow(handle);
+                },
+            .parent =
+                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle,
+                   zwlr_foreign_toplevel_handle_v1 * parent) {
+                    auto self = static_cast<TaskBar *>(data);
+                    self->mToplevels[toWindow(handle)].pendingParent =
+                        toWindow(parent);
+                },
+        };
+
+    zwlr_foreign_toplevel_handle_v1_add_listener(handle, &toplevel_handle_impl,
+                                                 this);
+    // the task is added once the initial state is known ("done")
+    mToplevels[toWindow(handle)].manager = manager;
+    perfCount("taskbar: Wayland handles created");
+}
+
+// Applies the changes staged since the last "done" event at once, so
+// that each update costs at most one repaint
+void TaskBar::applyToplevel(zwlr_foreign_toplevel_handle_v1 * handle)
+{
+    PerfTimer timer("taskbar: Wayland update");
+    WId window = toWindow(handle);
+    auto & toplevel = mToplevels[window];
+    bool titleChanged = false, appIdChanged = false;
+
+    if (toplevel.pendingTitle && *toplevel.pendingTitle != toplevel.title)
+    {
+        toplevel.title = *toplevel.pendingTitle;
+        titleChanged = true;
+    }
+
+    if (toplevel.pendingAppId && *toplevel.pendingAppId != toplevel.appId)
     {
-        auto button = pos->second;
-        mKnownWindows.erase(pos);
-        delete button;
+        toplevel.appId = *toplevel.pendingAppId;
+        appIdChanged = true;
     }
+
+    if (toplevel.pendingActivated)
+    {
+        if (*toplevel.pendingActivated && !toplevel.activated)
+            toplevel.activatedSerial = ++mActivations;
+        toplevel.activated = *toplevel.pendingActivated;
+    }
+
+    if (toplevel.pendingParent)
+        toplevel.parent = *toplevel.pendingParent;
+
+    toplevel.pendingTitle.reset();
+    toplevel.pendingAppId.reset();
+    toplevel.pendingActivated.reset();
+    toplevel.pendingParent.reset();
+
+    // toplevels of a stopped manager just wait to be destroyed
+    if (toplevel.manager != mManager)
+    {
+        removeTask(window);
+        return;
+    }
+
+    auto task = mModel.find(window);
+    bool wanted = wantToplevel(toplevel);
+
+    if (!wanted && task)
+    {
+        removeTask(window);
+        task = nullptr;
+    }
+    else if (wanted && !task)
+    {
+        addTask(window);
+        task = mModel.find(window);
+        titleChanged = appIdChanged = true;
+    }
+
+    if (task && titleChanged)
+        setTaskTitle(*task, toplevel.title);
+
+    // the icon is only looked up when the app ID changes
+    if (task && appIdChanged)
+    {
+        auto icon = mRes.getAppIcon(toplevel.appId);
+        if (!icon.isNull())
+            setTaskIcon(*task, icon);
+    }
+
+    // child windows (e.g. dialogs) activate their parent's button
+    WId owner = rootToplevel(window);
+    if (!mModel.contains(owner))
+        owner = 0;
+
+    // The compositor may deactivate the parent after activating a
+    // child, so the button stays checked while any of them is active
+    if (toplevel.activated)
+        setActiveTask(owner);
+    else if (owner && mActiveTask == owner && !isActivated(owner))
+        setActiveTask(0);
 }
 
-void TaskBar::onWindowAdded(WId window)
+// Follows parent relations (up to a few levels of nested dialogs)
+WId TaskBar::rootToplevel(WId window) const
 {
-    auto pos = mKnownWindows.find(window);
-    if (pos == mKnownWindows.end() && acceptWindow(window))
-        addWindow(window);
+    for (int depth = 0; depth < 8; depth++)
+    {
+        auto toplevel = mToplevels.find(window);
+        if (toplevel == mToplevels.end() || !toplevel->second.parent)
+            break;
+
+        window = toplevel->second.parent;
+    }
+
+    return window;
 }
 
-void TaskBar::onActiveWindowChanged(WId window)
+// Finds the most recently activated window among a window and its
+// children, which is presumably the one on top
+WId TaskBar::topmostChild(WId window) const
+{
+    auto parent = mToplevels.find(window);
+    if (parent == mToplevels.end())
+        return window;
+
+    WId topmost = window;
+    unsigned serial = parent->second.activatedSerial;
+
+    for (auto & [child, toplevel] : mToplevels)
+    {
+        if (toplevel.parent && toplevel.activatedSerial > serial &&
+            rootToplevel(child) == window)
+        {
+            topmost = child;
+            serial = toplevel.activatedSerial;
+        }
+    }
+
+    return topmost;
+}
+
+// Whether a window or any of its children is activated
+bool TaskBar::isActivated(WId window) const
+{
+    for (auto & [other, toplevel] : mToplevels)
+    {
+        if (toplevel.activated && rootToplevel(other) == window)
+            return true;
+    }
+
+    return false;
+}
+
+// Re-checks which toplevels should be shown
+void TaskBar::updateToplevels()
 {
-    auto active = mKnownWindows.find(window);
-    if (active == mKnownWindows.end())
+    for (auto & [window, toplevel] : mToplevels)
     {
-        KWindowInfo info(window, NET::Properties(), NET::WM2TransientFor);
-        active = mKnownWindows.find(info.transientFor());
+        if (toplevel.done)
+            applyToplevel(toHandle(window));
     }
+}
+
+bool TaskBar::wantToplevel(const Toplevel & toplevel) const
+{
+    if (toplevel.parent)
+        return false;
 
-    for (auto & pair : mKnownWindows)
+    auto panelScreen = screen();
+    if (!mRes.settings().taskBarScreenOnly || !panelScreen)
+        return true;
+
+    // windows not (yet) on any known output are shown
+    bool known = false;
+    for (auto output : toplevel.outputs)
     {
-        if (active == mKnownWindows.end() || pair.second != active->second)
-            pair.second->setChecked(false);
+        auto info = mOutputs.find(output);
+        if (info == mOutputs.end() || info->second.name.isEmpty())
+            continue;
+        if (info->second.name == panelScreen->name())
+            return true;
+
+        known = true;
     }
 
-    if (active != mKnownWindows.end())
-        active->second->setChecked(true);
+    return !known;
+}
+
+void TaskBar::removeWindow(zwlr_foreign_toplevel_handle_v1 * handle)
+{
+    PerfTimer timer("taskbar: Wayland toplevel closed");
+    WId window = toWindow(handle);
+    removeTask(window);
+    mToplevels.erase(window);
+    zwlr_foreign_toplevel_handle_v1_destroy(handle);
+    perfCount("taskbar: Wayland handles destroyed");
+
+    // the compositor should already have un-parented any children,
+    // but don't keep references to a destroyed handle regardless
+    for (auto & [child, toplevel] : mToplevels)
+    {
+        if (toplevel.parent == window)
+        {
+            toplevel.parent = 0;
+            if (toplevel.done)
+                applyToplevel(toHandle(child));
+        }
+    }
+}
+
+bool TaskBar::acceptWindow(WId window)
+{
+    const NET::WindowTypes ignoreList =
+        NET::DesktopMask | NET::DockMask | NET::SplashMask | NET::ToolbarMask |
+        NET::MenuMask | NET::PopupMenuMask | NET::NotificationMask;
+
+    KWindowInfo info(window, NET::WMWindowType | NET::WMState,
+                     NET::WM2TransientFor);
+
+    // remember transient-for relations for onActiveWindowChanged()
+    WId transFor = info.valid() ? info.transientFor() : 0;
+    bool isTransient = (transFor != 0 && transFor != window &&
+                        transFor != (WId)QX11Info::appRootWindow());
+    mModel.setTransientFor(window, isTransient ? transFor : 0);
+
+    if (!info.valid() ||
+        NET::typeMatchesMask(info.windowType(NET::AllTypesMask), ignoreList) ||
+        (info.state() & NET::SkipTaskbar))
+    {
+        return false;
+    }
+
+    return !isTransient;
+}
+
+void TaskBar::addWindow(WId window)
+{
+    if (!mModel.contains(window))
+        addTask(window);
+}
+
+void TaskBar::onWindowAdded(WId window)
+{
+    if (mModel.contains(window))
+        return;
+
+    // all windows are watched, since those not accepted now may
+    // change their type or state later
+    if (mPropertyFilter)
+        mPropertyFilter->selectWindow(window);
+
+    markDirty(window, DirtyAccept);
+}
+
+void TaskBar::onWindowRemoved(WId window)
+{
+    if (mPropertyFilter)
+        mPropertyFilter->forgetWindow(window);
+
+    mModel.setTransientFor(window, 0);
+    mDirtyWindows.erase(window);
+    removeTask(window);
+}
+
+void TaskBar::onActiveWindowChanged(WId window)
+{
+    mModel.setActiveWindow(window);
+    setActiveTask(mModel.activeTask());
 }
 
 void TaskBar::onWindowChanged(WId window, NET::Properties prop,
                               NET::Properties2 prop2)
 {
+    unsigned flags = 0;
     if (prop.testFlag(NET::WMWindowType) || prop.testFlag(NET::WMState) ||
         prop2.testFlag(NET::WM2TransientFor))
+        flags |= DirtyAccept;
+    if (prop.testFlag(NET::WMVisibleName) || prop.testFlag(NET::WMName))
+        flags |= DirtyTitle;
+    if (prop2.testFlag(NET::WM2WindowClass))
+        flags |= DirtyClass;
+    if (prop.testFlag(NET::WMIcon))
+        flags |= DirtyIcon;
+
+    // only events that lead to an update are counted, so that the
+    // statistics show the cost of each update
+    bool dirty = onPropertiesChanged(window, flags);
+    if (mKWinRequests)
+        mKWinRequests->finish(dirty);
+    if (dirty)
+        perfCount("taskbar: property events (KWindowSystem)");
+}
+
+void TaskBar::onPropertyChanged(WId window, xcb_atom_t atom)
+{
+    unsigned flags = 0;
+    if (atom == x11Atom(X11Atom::NetWmWindowType) ||
+        atom == x11Atom(X11Atom::NetWmState) ||
+        atom == XCB_ATOM_WM_TRANSIENT_FOR)
+        flags = DirtyAccept;
+    else if (atom == x11Atom(X11Atom::NetWmVisibleName) ||
+             atom == x11Atom(X11Atom::NetWmName) || atom == XCB_ATOM_WM_NAME)
+        flags = DirtyTitle;
+    else if (atom == XCB_ATOM_WM_CLASS)
+        flags = DirtyClass;
+    else if (atom == x11Atom(X11Atom::NetWmIcon))
+        flags = DirtyIcon;
+
+    if (onPropertiesChanged(window, flags))
+        perfCount("taskbar: property events (native filter)");
+}
+
+// Returns true if the window was marked dirty
+bool TaskBar::onPropertiesChanged(WId window, unsigned flags)
+{
+    if (flags & DirtyIcon)
+        mIconHeaders.erase(window);
+
+    // title and icon changes are only of interest for known windows
+    if (!flags || (!(flags & DirtyAccept) && !mModel.contains(window)))
+        return false;
+
+    markDirty(window, flags);
+    return true;
+}
+
+X11IconRequest TaskBar::requestIcon(WId window) const
+{
+    int size = style()->pixelMetric(QStyle::PM_ToolBarIconSize);
+    size *= devicePixelRatioF();
+
+    auto headers = mIconHeaders.find(window);
+    return X11IconRequest(window, size,
+                          (headers != mIconHeaders.end()) ? &headers->second
+                                                          : nullptr);
+}
+
+void TaskBar::markDirty(WId window, unsigned flags)
+{
+    mDirtyWindows[window] |= flags;
+    if (!mFlushTimer.isActive())
+        mFlushTimer.start();
+}
+
+void TaskBar::flushDirtyWindows()
+{
+    PerfTimer timer("taskbar: X11 flush");
+    // finish any previous flush first
+    collectReplies();
+
+    // counted from here, since collectReplies() counts its own
+    X11RequestCounter requests("taskbar: X11 requests (own)");
+
+    // events are selected before any properties are read
+    if (mPropertyFilter)
+        mPropertyFilter->flushSelections();
+
+    auto dirtyWindows = std::move(mDirtyWindows);
+    mDirtyWindows.clear();
+
+    for (auto [window, flags] : dirtyWindows)
+    {
+        if (flags & DirtyAccept)
+        {
+            bool known = mModel.contains(window);
+            if (!acceptWindow(window))
+                removeTask(window);
+            else if (!known)
+            {
+                addWindow(window);
+                // the icon is chosen once WM_CLASS is known
+                flags |= DirtyTitle | DirtyClass;
+            }
+
+            // A dialog is usually activated before its WM_TRANSIENT_FOR
+            // has been read, so the owner's button may need to be
+            // checked only now
+            if (mModel.activeTask() != mActiveTask)
+                setActiveTask(mModel.activeTask());
+        }
+
+        auto task = mModel.find(window);
+        if (!task)
+            continue;
+
+        // properties are requested for all windows before any replies
+        // are read, so the whole batch costs a single round-trip
+        if (flags & DirtyTitle)
+            mPendingTitles.emplace_back(window, X11TitleRequest(window));
+        if (flags & DirtyClass)
+            mPendingClasses.emplace_back(window, X11ClassRequest(window));
+
+        // _NET_WM_ICON is not needed if the application's theme icon
+        // is being used (and is not re-read if WM_CLASS is pending)
+        if ((flags & DirtyIcon) && !(flags & DirtyClass) &&
+            !(task->flags & TaskWindow::AppIcon))
+            mPendingIcons.emplace_back(window, requestIcon(window));
+    }
+
+    if (!mPendingTitles.empty() || !mPendingClasses.empty() ||
+        !mPendingIcons.empty())
+    {
+        // read the replies on the next pass through the event loop
+        xcb_flush(x11Connection());
+        QMetaObject::invokeMethod(this, &TaskBar::collectReplies,
+                                  Qt::QueuedConnection);
+    }
+}
+
+void TaskBar::collectReplies()
+{
+    X11RequestCounter requests("taskbar: X11 requests (own)");
+    auto pendingTitles = std::move(mPendingTitles);
+    auto pendingClasses = std::move(mPendingClasses);
+    auto pendingIcons = std::move(mPendingIcons);
+    mPendingTitles.clear();
+    mPendingClasses.clear();
+    mPendingIcons.clear();
+
+    for (auto & [window, request] : pendingTitles)
     {
-        if (acceptWindow(window))
-            addWindow(window);
+        auto title = request.reply();
+        if (auto task = mModel.find(window))
+            setTaskTitle(*task, title);
+    }
+
+    // Prefer the icon from a matching .desktop file, which is usually
+    // already loaded and looks better.  Fall back to _NET_WM_ICON.
+    for (auto & [window, request] : pendingClasses)
+    {
+        auto [instance, wmClass] = request.reply();
+        auto task = mModel.find(window);
+        if (!task)
+            continue;
+
+        auto icon = mRes.getWMClassIcon(instance, wmClass);
+        if (!icon.isNull())
+        {
+            task->flags |= TaskWindow::AppIcon;
+            task->iconKey = 0;
+            setTaskIcon(*task, icon);
+        }
         else
-            removeWindow(window);
+            pendingIcons.emplace_back(window, requestIcon(window));
     }
 
-    auto pos = mKnownWindows.find(window);
-    if (pos == mKnownWindows.end())
-        return;
+    // icon requests take several steps (see X11IconRequest)
+    bool stepping = true;
+    while (stepping)
+    {
+        stepping = false;
+        for (auto & pair : pendingIcons)
+            stepping |= pair.second.step();
+    }
 
-    if (prop.testFlag(NET::WMVisibleName) || prop.testFlag(NET::WMName))
-        pos->second->updateText();
-    if (prop.testFlag(NET::WMIcon))
-        pos->second->updateIcon();
+    for (auto & [window, request] : pendingIcons)
+    {
+        size_t key = request.hash();
+        auto task = mModel.find(window);
+        auto dirty = mDirtyWindows.find(window);
+        bool changed =
+            (dirty != mDirtyWindows.end() && (dirty->second & DirtyIcon));
+
+        // keep headers until the icon property changes again
+        if (task && request.headers() && !changed)
+            mIconHeaders[window] = *request.headers();
+
+        // skip decoding if the icon was re-sent without changes
+        if (!task ||
+            (!(task->flags & TaskWindow::AppIcon) && task->iconKey == key))
+            continue;
+
+        // identical icons (e.g. from several terminal windows) are
+        // decoded only once and then shared between buttons
+        QIcon icon;
+        if (auto cached = key ? mIconCache.find(key) : nullptr)
+            icon = *cached;
+        else if (key)
+        {
+            auto image = request.image();
+            if (!image.isNull())
+            {
+                icon = QIcon(QPixmap::fromImage(image));
+                mIconCache.insert(key, icon);
+            }
+        }
+
+        task->flags &= ~TaskWindow::AppIcon;
+        task->iconKey = key;
+        setTaskIcon(*task, icon);
+    }
 }
@@ -32,15 +32,24 @@
 #ifndef TASKBAR_H
 #define TASKBAR_H
 
+#include "taskmodel.h"
+#include "x11props.h"
+
 #include <NETWM>
-#include <QHBoxLayout>
+#include <QElapsedTimer>
+#include <QMenu>
+#include <QTimer>
+#include <QToolButton>
 #include <QWidget>
+#include <memory>
+#include <optional>
 #include <unordered_map>
+#include <vector>
 
 class Resources;
-class TaskButtonX11;
-class TaskButtonWayland;
+class TaskButton;
 
+struct wl_output;
 struct wl_registry;
 struct zwlr_foreign_toplevel_handle_v1;
 struct zwlr_foreign_toplevel_manager_v1;
@@ -49,25 +58,161 @@ class TaskBar : public QWidget
 {
 public:
     explicit TaskBar(Resources & res, QWidget * parent);
+    ~TaskBar();
+
+    bool isActiveTask(WId window) const
+    {
+        return window && window == mActiveTask;
+    }
+    void activateTask(WId window);
+    void minimizeTask(WId window);
+    void closeTask(WId window);
+
+    // activates a window after a drag hovers over its button briefly
+    void startDragActivate(WId window);
+    void stopDragActivate();
 
     // Wayland-specific
     void addToplevelManager(wl_registry * registry, uint32_t name,
                             uint32_t version);
-    void addWindow(zwlr_foreign_toplevel_handle_v1 * handle);
+    void addOutput(wl_registry * registry, uint32_t name, uint32_t version);
+    void removeGlobal(uint32_t name);
+    void addWindow(zwlr_foreign_toplevel_manager_v1 * manager,
+                   zwlr_foreign_toplevel_handle_v1 * handle);
+
+    QSize sizeHint() const override;
+    QSize minimumSizeHint() const override;
+
+protected:
+    void changeEvent(QEvent * event) override;
+    void resizeEvent(QResizeEvent * event) override;
+    void showEvent(QShowEvent * event) override;
+    void wheelEvent(QWheelEvent * event) override;
 
 private:
+    friend class TestClient; // see tests/testclient.h
+
+    // Windows that disappear within this time never get a button
+    static constexpr int GracePeriod = 200; // msecs
+    // Maximum number of unused buttons kept for re-use (buttons exist
+    // only for the tasks that are currently visible)
+    static constexpr int MaxSpareButtons = 16;
+
+    void addTask(WId window);
+    void removeTask(WId window);
+    void setTaskTitle(TaskWindow & task, const QString & title);
+    void setTaskIcon(TaskWindow & task, const QIcon & icon);
+    void setActiveTask(WId window);
+    void realizeTasks();
+    void acquireButton(TaskWindow & task);
+    void releaseButton(TaskWindow & task);
+    void updateMetrics();
+    void scheduleLayout();
+    void updateLayout();
+    void scrollBy(int buttons);
+    void buildOverflowMenu();
+
     // X11-specific
-    bool acceptWindow(WId window) const;
+    enum DirtyFlag
+    {
+        DirtyAccept = (1 << 0),
+        DirtyTitle = (1 << 1),
+        DirtyClass = (1 << 2),
+        DirtyIcon = (1 << 3)
+    };
+
+    bool acceptWindow(WId window);
     void addWindow(WId window);
-    void removeWindow(WId window);
     void onWindowAdded(WId window);
+    void onWindowRemoved(WId window);
     void onActiveWindowChanged(WId window);
     void onWindowChanged(WId window, NET::Properties prop,
                          NET::Properties2 prop2);
+    void onPropertyChanged(WId window, xcb_atom_t atom);
+    bool onPropertiesChanged(WId window, unsigned flags);
+    X11IconRequest requestIcon(WId window) const;
+    void markDirty(WId window, unsigned flags);
+    void flushDirtyWindows();
+    void collectReplies();
+
+    // Wayland-specific
+    void stopToplevelManager();
+    void finishToplevelManager(zwlr_foreign_toplevel_manager_v1 * manager);
+    void applyToplevel(zwlr_foreign_toplevel_handle_v1 * handle);
+    void updateToplevels();
+    WId rootToplevel(WId window) const;
+    WId topmostChild(WId window) const;
+    bool isActivated(WId window) const;
+    void removeWindow(zwlr_foreign_toplevel_handle_v1 * handle);
 
     Resources & mRes;
-    std::unordered_map<WId, TaskButtonX11 *> mKnownWindows;
-    QHBoxLayout mLayout;
+    TaskModel mModel;
+    WId mActiveTask = 0;
+    QElapsedTimer mClock;
+    QTimer mRealizeTimer;
+    std::vector<TaskButton *> mSpareButtons;
+
+    // layout metrics, updated only when the style or font changes
+    int mButtonHeight = 0;
+    int mMaxButtonWidth = 0;
+    int mMinButtonWidth = 0;
+    int mArrowWidth = 0;
+    int mScrollPos = 0; // index of the first visible button
+    QTimer mLayoutTimer;
+    QToolButton mScrollLeft, mScrollRight, mOverflowButton;
+    QMenu mOverflowMenu;
+
+    QTimer mDragTimer;
+    WId mDragWindow = 0;
+
+    // X11-specific
+    std::unique_ptr<X11PropertyFilter> mPropertyFilter;
+    std::unique_ptr<X11EventRequestCounter> mKWinRequests;
+    std::unordered_map<WId, unsigned> mDirtyWindows;
+    std::vector<std::pair<WId, X11TitleRequest>> mPendingTitles;
+    std::vector<std::pair<WId, X11ClassRequest>> mPendingClasses;
+    std::vector<std::pair<WId, X11IconRequest>> mPendingIcons;
+    std::unordered_map<WId, X11IconHeaders> mIconHeaders;
+    LruCache<size_t, QIcon> mIconCache{64};
+    QTimer mFlushTimer;
+
+    // Wayland-specific
+    wl_registry * mRegistry = nullptr;
+    zwlr_foreign_toplevel_manager_v1 * mManager = nullptr;
+    uint32_t mManagerGlobal = 0;
+    // stopped but still waiting for the "finished" event
+    std::vector<zwlr_foreign_toplevel_manager_v1 *> mStoppedManagers;
+
+    // state of each toplevel handle; changes are staged and then
+    // applied together on the "done" event
+    struct Toplevel
+    {
+        zwlr_foreign_toplevel_manager_v1 * manager = nullptr;
+        QString title, appId;
+        bool activated = false;
+        bool done = false; // initial state received
+        WId parent = 0;
+        unsigned activatedSerial = 0; // see mActivations
+        std::vector<wl_output *> outputs;
+        std::optional<QString> pendingTitle;
+        std::optional<QString> pendingAppId;
+        std::optional<bool> pendingActivated;
+        std::optional<WId> pendingParent;
+    };
+
+    bool wantToplevel(const Toplevel & toplevel) const;
+
+    std::unordered_map<WId, Toplevel> mToplevels;
+    unsigned mActivations = 0;
+
+    // Wayland-specific: outputs are matched to screens by name
+    struct Output
+    {
+        uint32_t global;
+        QString name;
+    };
+
+    std::unordered_map<wl_output *, Output> mOutputs;
 };
 
 #endif // TASKBAR_H
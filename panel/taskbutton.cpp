@@ -29,58 +29,76 @@
  * END_COMMON_COPYRIGHT_HEADER */
 
 #include "taskbutton.h"
-#include "resources.h"
-#include "wlr-foreign-toplevel-management-unstable-v1.h"
+#include "perfstats.h"
+#include "taskbar.h"
+#include "taskmodel.h"
 
-#include <KWindowInfo>
-#include <KX11Extras>
-#include <NETWM>
 #include <QDragEnterEvent>
-#include <QGuiApplication>
 #include <QStyle>
-#include <QTimer>
-#include <private/qtx11extras_p.h>
+#include <QStylePainter>
 
-TaskButton::TaskButton(QWidget * parent) : QToolButton(parent)
+TaskButton::TaskButton(TaskBar * taskBar)
+    : QToolButton(taskBar), mTaskBar(taskBar)
 {
     setCheckable(true);
     setToolButtonStyle(Qt::ToolButtonTextBesideIcon);
     setAcceptDrops(true);
 
-    mTimer.setSingleShot(true);
-    mTimer.setInterval(500);
-
     connect(this, &QToolButton::clicked, [this](bool checked) {
+        // Qt toggles the button on click, but it is only checked once
+        // the window manager reports the window as active (which it may
+        // not do, e.g. if activation fails)
+        setChecked(mTaskBar->isActiveTask(mTask));
+
         if (checked)
-            activateWindow();
+            mTaskBar->activateTask(mTask);
         else
-            minimizeWindow();
+            mTaskBar->minimizeTask(mTask);
     });
+}
+
+void TaskButton::bind(const TaskWindow & task)
+{
+    mTask = task.id;
+    setTitle(task.title);
+    updateIcon(task.icon);
+    setChecked(task.flags & TaskWindow::Active);
+}
+
+void TaskButton::unbind() { mTask = 0; }
+
+void TaskButton::setTitle(const QString & title)
+{
+    if (title == mTitle)
+        return;
 
-    connect(&mTimer, &QTimer::timeout, this, &TaskButton::activateWindow);
+    mTitle = title;
+    mElidedWidth = -1;
+    setText(QString(title).replace("&", "&&"));
+    setToolTip(title);
 }
 
-QSize TaskButton::sizeHint() const
+void TaskButton::updateIcon(const QIcon & icon)
 {
-    return {2 * logicalDpiX(), QToolButton::sizeHint().height()};
+    setIcon(icon.isNull() ? style()->standardIcon(QStyle::SP_FileIcon) : icon);
 }
 
 void TaskButton::dragEnterEvent(QDragEnterEvent * event)
 {
-    mTimer.start();
+    mTaskBar->startDragActivate(mTask);
     event->acceptProposedAction();
     QToolButton::dragEnterEvent(event);
 }
 
 void TaskButton::dragLeaveEvent(QDragLeaveEvent * event)
 {
-    mTimer.stop();
+    mTaskBar->stopDragActivate();
     QToolButton::dragLeaveEvent(event);
 }
 
 void TaskButton::dropEvent(QDropEvent * event)
 {
-    mTimer.stop();
+    mTaskBar->stopDragActivate();
     QToolButton::dropEvent(event);
 }
 
@@ -88,7 +106,7 @@ void TaskButton::mousePressEvent(QMouseEvent * event)
 {
     if (event->button() == Qt::MiddleButton)
     {
-        closeWindow();
+        mTaskBar->closeTask(mTask);
         event->accept();
         return;
     }
@@ -96,143 +114,55 @@ void TaskButton::mousePressEvent(QMouseEvent * event)
     QToolButton::mousePressEvent(event);
 }
 
-TaskButtonX11::TaskButtonX11(const WId window, QWidget * parent)
-    : TaskButton(parent), mWindow(window)
-{
-    updateText();
-    updateIcon();
-
-    if (KX11Extras::activeWindow() == window)
-        setChecked(true);
-}
-
-void TaskButtonX11::updateText()
-{
-    KWindowInfo info(mWindow, NET::WMVisibleName | NET::WMName);
-    QString title = info.visibleName();
-    if (title.isEmpty())
-        title = info.name();
-
-    setText(title.replace("&", "&&"));
-    setToolTip(title);
-}
-
-void TaskButtonX11::updateIcon()
-{
-    int size = style()->pixelMetric(QStyle::PM_ToolBarIconSize);
-    size *= devicePixelRatioF();
-    QIcon icon = KX11Extras::icon(mWindow, size, size);
-    if (icon.isNull())
-        icon = style()->standardIcon(QStyle::SP_FileIcon);
-    setIcon(icon);
-}
-
-void TaskButtonX11::activateWindow()
+void TaskButton::changeEvent(QEvent * event)
 {
-    KX11Extras::forceActiveWindow(mWindow);
-    // need to flush if called from timer
-    xcb_flush(QX11Info::connection());
-}
-
-void TaskButtonX11::minimizeWindow() { KX11Extras::minimizeWindow(mWindow); }
+    if (event->type() == QEvent::FontChange ||
+        event->type() == QEvent::StyleChange)
+    {
+        updateTextWidth();
+        mElidedWidth = -1;
+    }
 
-void TaskButtonX11::closeWindow()
-{
-    NETRootInfo info(QX11Info::connection(), NET::CloseWindow);
-    info.closeWindowRequest(mWindow);
+    QToolButton::changeEvent(event);
 }
 
-TaskButtonWayland::TaskButtonWayland(Resources & res,
-                                     zwlr_foreign_toplevel_handle_v1 * handle,
-                                     QWidget * parent)
-    : TaskButton(parent), mRes(res), mHandle(handle)
+void TaskButton::resizeEvent(QResizeEvent * event)
 {
-    static const zwlr_foreign_toplevel_handle_v1_listener toplevel_handle_impl =
-        {
-            .title =
-                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle,
-                   const char * title) {
-                    auto self = static_cast<TaskButtonWayland *>(data);
-                    self->setText(QString(title).replace("&", "&&"));
-                    self->setToolTip(title);
-                },
-            .app_id =
-                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle,
-                   const char * app_id) {
-                    static_cast<TaskButtonWayland *>(data)->setAppName(app_id);
-                },
-            .output_enter =
-                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle,
-                   wl_output * output) {
-                    /* no-op */
-                },
-            .output_leave =
-                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle,
-                   wl_output * output) {
-                    /* no-op */
-                },
-            .state =
-                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle,
-                   wl_array * state) {
-                    auto start = static_cast<const uint32_t *>(state->data);
-                    auto end = start + (state->size / sizeof(uint32_t));
-                    bool activated =
-                        (std::find(
-                             start, end,
-                             ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED) !=
-                         end);
-                    static_cast<TaskButtonWayland *>(data)->setChecked(
-                        activated);
-                },
-            .done =
-                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle) {
-                    /* no-op */
-                },
-            .closed =
-                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle) {
-                    auto self = static_cast<TaskButtonWayland *>(data);
-                    self->deleteLater();
-                },
-            .parent =
-                [](void * data, zwlr_foreign_toplevel_handle_v1 * handle,
-                   zwlr_foreign_toplevel_handle_v1 * parent) {
-                    /* no-op */
-                },
-        };
-
-    zwlr_foreign_toplevel_handle_v1_add_listener(handle, &toplevel_handle_impl,
-                                                 this);
-
-    // set default icon (usually changed from app_id callback)
-    setIcon(style()->standardIcon(QStyle::SP_FileIcon));
+    updateTextWidth();
+    QToolButton::resizeEvent(event);
 }
 
-TaskButtonWayland::~TaskButtonWayland()
+// Same as QToolButton::paintEvent() but draws the cached elided title,
+// so that long titles are not measured and shaped on every repaint
+void TaskButton::paintEvent(QPaintEvent *)
 {
-    zwlr_foreign_toplevel_handle_v1_destroy(mHandle);
-}
+    PerfTimer timer("taskbar: button paint");
 
-void TaskButtonWayland::activateWindow()
-{
-    auto waylandApp =
-        qGuiApp->nativeInterface<QNativeInterface::QWaylandApplication>();
-    zwlr_foreign_toplevel_handle_v1_unset_minimized(mHandle);
-    zwlr_foreign_toplevel_handle_v1_activate(mHandle, waylandApp->seat());
-}
+    if (mElidedWidth != mTextWidth)
+    {
+        PerfTimer timer("taskbar: title elide");
+        mElidedText = fontMetrics().elidedText(mTitle, Qt::ElideRight,
+                                               mTextWidth);
+        mElidedText.replace("&", "&&");
+        mElidedWidth = mTextWidth;
+    }
 
-void TaskButtonWayland::minimizeWindow()
-{
-    zwlr_foreign_toplevel_handle_v1_set_minimized(mHandle);
+    QStylePainter painter(this);
+    QStyleOptionToolButton option;
+    initStyleOption(&option);
+    option.text = mElidedText;
+    painter.drawComplexControl(QStyle::CC_ToolButton, option);
 }
 
-void TaskButtonWayland::closeWindow()
+// space left for the title beside the icon
+void TaskButton::updateTextWidth()
 {
-    zwlr_foreign_toplevel_handle_v1_close(mHandle);
-}
+    int margin = style()->pixelMetric(QStyle::PM_ButtonMargin, nullptr, this);
+    int frame =
+        style()->pixelMetric(QStyle::PM_DefaultFrameWidth, nullptr, this);
+    int spacing = fontMetrics().horizontalAdvance(QLatin1Char(' '));
 
-void TaskButtonWayland::setAppName(const QString & appName)
-{
-    auto icon = mRes.getAppIcon(appName);
-    if (!icon.isNull())
-        setIcon(icon);
+    mTextWidth = qMax(width() - 2 * (margin + frame) - iconSize().width() -
+                          spacing,
+                      0);
 }
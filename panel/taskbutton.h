@@ -28,71 +28,48 @@
  *
  * END_COMMON_COPYRIGHT_HEADER */
 
+
 #ifndef TASKBUTTON_H
 #define TASKBUTTON_H
 
-#include <QTimer>
 #include <QToolButton>
 
-class Resources;
-struct zwlr_foreign_toplevel_handle_v1;
+class TaskBar;
+struct TaskWindow;
 
+// Buttons are pooled by TaskBar and bound to one TaskWindow at a time
 class TaskButton : public QToolButton
 {
 public:
-    QSize sizeHint() const override;
+    explicit TaskButton(TaskBar * taskBar);
 
-protected:
-    TaskButton(QWidget * parent);
+    WId task() const { return mTask; } // see TaskWindow::id
+    void bind(const TaskWindow & task);
+    void unbind();
+
+    void setTitle(const QString & title);
+    void updateIcon(const QIcon & icon);
 
+protected:
     void dragEnterEvent(QDragEnterEvent * event) override;
     void dragLeaveEvent(QDragLeaveEvent * event) override;
     void dropEvent(QDropEvent * event) override;
     void mousePressEvent(QMouseEvent * event) override;
-
-    virtual void activateWindow() = 0;
-    virtual void minimizeWindow() = 0;
-    virtual void closeWindow() = 0;
+    void changeEvent(QEvent * event) override;
+    void resizeEvent(QResizeEvent * event) override;
+    void paintEvent(QPaintEvent * event) override;
 
 private:
-    QTimer mTimer;
-    bool mHideOnRelease = false;
-};
+    void updateTextWidth();
 
-class TaskButtonX11 : public TaskButton
-{
-public:
-    TaskButtonX11(const WId window, QWidget * parent);
-
-    void updateText();
-    void updateIcon();
-
-protected:
-    void activateWindow() override;
-    void minimizeWindow() override;
-    void closeWindow() override;
-
-private:
-    WId const mWindow;
-};
-
-class TaskButtonWayland : public TaskButton
-{
-public:
-    TaskButtonWayland(Resources & res, zwlr_foreign_toplevel_handle_v1 * handle,
-                      QWidget * parent);
-    ~TaskButtonWayland();
-
-protected:
-    void activateWindow() override;
-    void minimizeWindow() override;
-    void closeWindow() override;
-
-private:
-    void setAppName(const QString & appName);
+    TaskBar * const mTaskBar;
+    WId mTask = 0;
 
-    Resources & mRes;
-    zwlr_foreign_toplevel_handle_v1 * const mHandle;
+    // elided title, valid while mElidedWidth == mTextWidth
+    QString mTitle;
+    QString mElidedText;
+    int mTextWidth = 0;
+    int mElidedWidth = -1;
 };
 
 #endif // TASKBUTTON_H
@@ -0,0 +1,77 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "taskmodel.h"
+
+TaskWindow * TaskModel::find(WId id)
+{
+    auto pos = mIndex.find(id);
+    return (pos != mIndex.end()) ? &mRows[pos->second] : nullptr;
+}
+
+TaskWindow & TaskModel::add(WId id)
+{
+    mIndex.emplace(id, mRows.size());
+    auto & row = mRows.emplace_back();
+    row.id = id;
+    return row;
+}
+
+void TaskModel::remove(WId id)
+{
+    auto pos = mIndex.find(id);
+    if (pos == mIndex.end())
+        return;
+
+    size_t idx = pos->second;
+    mIndex.erase(pos);
+    mRows.erase(mRows.begin() + idx);
+
+    for (; idx < mRows.size(); idx++)
+        mIndex[mRows[idx].id] = idx;
+}
+
+void TaskModel::setTransientFor(WId window, WId leader)
+{
+    if (leader)
+        mTransientFor[window] = leader;
+    else
+        mTransientFor.erase(window);
+}
+
+WId TaskModel::findTask(WId window) const
+{
+    for (int depth = 0; window && depth < 8; depth++)
+    {
+        if (contains(window))
+            return window;
+
+        auto leader = mTransientFor.find(window);
+        window = (leader != mTransientFor.end()) ? leader->second : 0;
+    }
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef TASKMODEL_H
+#define TASKMODEL_H
+
+#include <QIcon>
+#include <QString>
+#include <qwindowdefs.h>
+#include <unordered_map>
+#include <vector>
+
+class TaskButton;
+
+// State of one taskbar entry, kept separately from any widget.
+// The ID is an X11 window or (under Wayland) a toplevel handle.
+struct TaskWindow
+{
+    enum Flag
+    {
+        Active = (1 << 0),
+        AppIcon = (1 << 1), // icon is from a .desktop file
+        Ready = (1 << 2)    // past the grace period, see TaskBar
+    };
+
+    WId id = 0;
+    QString title;
+    QIcon icon;
+    size_t iconKey = 0;
+    unsigned flags = 0;
+    qint64 addedAt = 0;            // msecs, see TaskBar::mClock
+    TaskButton * button = nullptr; // null unless on screen
+};
+
+// Rows are stored in display order in a flat vector.  Pointers returned
+// by find() are only valid until the next call to add() or remove().
+class TaskModel
+{
+public:
+    std::vector<TaskWindow>::iterator begin() { return mRows.begin(); }
+    std::vector<TaskWindow>::iterator end() { return mRows.end(); }
+    size_t size() const { return mRows.size(); }
+
+    bool contains(WId id) const { return mIndex.count(id); }
+    TaskWindow * find(WId id);
+
+    TaskWindow & add(WId id);
+    void remove(WId id);
+
+    // X11-specific: transient-for relations (e.g. of dialogs to their
+    // main windows) are kept for any window, not only tasks.  A leader
+    // of 0 forgets the relation.
+    void setTransientFor(WId window, WId leader);
+
+    // Finds the task for a window, or else for the window it is
+    // transient for (following a few levels of nested dialogs).
+    // Returns 0 if none.
+    WId findTask(WId window) const;
+
+    // The task for the active window, which may also be a dialog whose
+    // WM_TRANSIENT_FOR is only known later
+    void setActiveWindow(WId window) { mActiveWindow = window; }
+    WId activeTask() const { return findTask(mActiveWindow); }
+
+private:
+    std::vector<TaskWindow> mRows;
+    std::unordered_map<WId, size_t> mIndex;
+    std::unordered_map<WId, WId> mTransientFor;
+    WId mActiveWindow = 0;
+};
+
+#endif // TASKMODEL_H
@@ -28,7 +28,9 @@
 #define UTILS_H
 
 #include <QString>
+#include <list>
 #include <memory>
+#include <unordered_map>
 
 template<typename T>
 using AutoPtr = std::unique_ptr<T, void (*)(T *)>;
@@ -42,4 +44,49 @@ public:
     explicit operator QString() const { return get(); }
 };
 
+// Bounded cache which drops the least recently used entry when full
+template<typename K, typename V, typename Hash = std::hash<K>>
+class LruCache
+{
+public:
+    explicit LruCache(size_t capacity) : mCapacity(capacity) {}
+
+    const V * find(const K & key)
+    {
+        auto pos = mIndex.find(key);
+        if (pos == mIndex.end())
+            return nullptr;
+
+        mEntries.splice(mEntries.begin(), mEntries, pos->second);
+        return &pos->second->second;
+    }
+
+    void insert(const K & key, V value)
+    {
+        auto pos = mIndex.find(key);
+        if (pos != mIndex.end())
+        {
+            pos->second->second = std::move(value);
+            mEntries.splice(mEntries.begin(), mEntries, pos->second);
+            return;
+        }
+
+        mEntries.emplace_front(key, std::move(value));
+        mIndex.emplace(key, mEntries.begin());
+
+        if (mEntries.size() > mCapacity)
+        {
+            mIndex.erase(mEntries.back().first);
+            mEntries.pop_back();
+        }
+    }
+
+private:
+    using Entries = std::list<std::pair<K, V>>;
+
+    size_t const mCapacity;
+    Entries mEntries;
+    std::unordered_map<K, typename Entries::iterator, Hash> mIndex;
+};
+
 #endif
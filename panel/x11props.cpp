@@ -0,0 +1,413 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "x11props.h"
+#include "perfstats.h"
+
+#include <QCoreApplication>
+#include <QHash>
+#include <cstring>
+#include <iterator>
+#include <private/qtx11extras_p.h>
+
+xcb_connection_t * x11Connection() { return QX11Info::connection(); }
+
+xcb_atom_t x11Atom(X11Atom atom)
+{
+    static const char * const names[] = {
+        "_NET_WM_ICON",
+        "_NET_WM_NAME",
+        "_NET_WM_STATE",
+        "_NET_WM_VISIBLE_NAME",
+        "_NET_WM_WINDOW_TYPE",
+        "UTF8_STRING",
+    };
+
+    static_assert(std::size(names) == (size_t)X11Atom::Count);
+
+    static xcb_atom_t atoms[(int)X11Atom::Count];
+    static bool interned = false;
+
+    if (!interned)
+    {
+        auto conn = x11Connection();
+        xcb_intern_atom_cookie_t cookies[(int)X11Atom::Count];
+
+        // send all requests first to avoid multiple round-trips
+        for (int i = 0; i < (int)X11Atom::Count; i++)
+            cookies[i] = xcb_intern_atom(conn, false, strlen(names[i]),
+                                         names[i]);
+
+        for (int i = 0; i < (int)X11Atom::Count; i++)
+        {
+            AutoPtrV<xcb_intern_atom_reply_t> reply(
+                xcb_intern_atom_reply(conn, cookies[i], nullptr), free);
+            atoms[i] = reply ? reply->atom : XCB_ATOM_NONE;
+        }
+
+        interned = true;
+    }
+
+    return atoms[(int)atom];
+}
+
+xcb_get_property_cookie_t x11RequestProperty(WId window, xcb_atom_t property,
+                                             xcb_atom_t type, uint32_t offset,
+                                             uint32_t length)
+{
+    return xcb_get_property(x11Connection(), false, window, property, type,
+                            offset, length);
+}
+
+X11PropertyReply x11PropertyReply(xcb_get_property_cookie_t cookie)
+{
+    return X11PropertyReply(
+        xcb_get_property_reply(x11Connection(), cookie, nullptr), free);
+}
+
+X11PropertyFilter::X11PropertyFilter(Callback callback)
+    : mCallback(std::move(callback))
+{
+    QCoreApplication::instance()->installNativeEventFilter(this);
+}
+
+X11PropertyFilter::~X11PropertyFilter()
+{
+    QCoreApplication::instance()->removeNativeEventFilter(this);
+}
+
+void X11PropertyFilter::selectWindow(WId window)
+{
+    if (!mWindows.insert(window).second)
+        return;
+
+    // the event mask replaces any other events this connection (e.g.
+    // KWindowSystem) has selected, so it must be read first
+    mPending.emplace_back(
+        window, xcb_get_window_attributes(x11Connection(), window));
+}
+
+void X11PropertyFilter::flushSelections()
+{
+    auto conn = x11Connection();
+    for (auto & [window, cookie] : mPending)
+    {
+        AutoPtrV<xcb_get_window_attributes_reply_t> reply(
+            xcb_get_window_attributes_reply(conn, cookie, nullptr), free);
+
+        // the window may be gone already
+        if (!reply || !mWindows.count(window))
+            continue;
+
+        uint32_t mask = reply->your_event_mask;
+        if (mask & XCB_EVENT_MASK_PROPERTY_CHANGE)
+            continue;
+
+        mask |= XCB_EVENT_MASK_PROPERTY_CHANGE;
+        xcb_change_window_attributes(conn, window, XCB_CW_EVENT_MASK, &mask);
+    }
+
+    mPending.clear();
+}
+
+bool X11PropertyFilter::nativeEventFilter(const QByteArray & eventType,
+                                          void * message, qintptr *)
+{
+    if (eventType != "xcb_generic_event_t")
+        return false;
+
+    auto event = static_cast<xcb_generic_event_t *>(message);
+    if ((event->response_type & ~0x80) == XCB_PROPERTY_NOTIFY)
+    {
+        // ignore events for other windows (e.g. the panel's own)
+        auto notify = reinterpret_cast<xcb_property_notify_event_t *>(event);
+        if (mWindows.count(notify->window))
+            mCallback(notify->window, notify->atom);
+    }
+
+    return false;
+}
+
+uint32_t x11RequestSequence()
+{
+    return xcb_no_operation(x11Connection()).sequence;
+}
+
+X11RequestCounter::X11RequestCounter(const char * name) : mName(name)
+{
+    if (perfStatsEnabled())
+        mStart = x11RequestSequence();
+}
+
+X11RequestCounter::~X11RequestCounter()
+{
+    // not counting the NoOperation requests themselves
+    if (perfStatsEnabled())
+        perfCount(mName, x11RequestSequence() - mStart - 1);
+}
+
+X11EventRequestCounter::X11EventRequestCounter(const char * name)
+    : mName(name)
+{
+    QCoreApplication::instance()->installNativeEventFilter(this);
+}
+
+X11EventRequestCounter::~X11EventRequestCounter()
+{
+    QCoreApplication::instance()->removeNativeEventFilter(this);
+}
+
+void X11EventRequestCounter::finish(bool counted)
+{
+    if (!mStarted)
+        return;
+
+    if (counted)
+        perfCount(mName, x11RequestSequence() - mStart - 1);
+
+    mStarted = false;
+}
+
+bool X11EventRequestCounter::nativeEventFilter(const QByteArray & eventType,
+                                               void * message, qintptr *)
+{
+    if (eventType != "xcb_generic_event_t")
+        return false;
+
+    auto event = static_cast<xcb_generic_event_t *>(message);
+    if ((event->response_type & ~0x80) == XCB_PROPERTY_NOTIFY)
+    {
+        mStart = x11RequestSequence();
+        mStarted = true;
+    }
+
+    return false;
+}
+
+static QString stringFromReply(const X11PropertyReply & reply)
+{
+    if (!reply || reply->format != 8)
+        return QString();
+
+    auto data = static_cast<const char *>(xcb_get_property_value(reply.get()));
+    int len = xcb_get_property_value_length(reply.get());
+
+    if (reply->type == x11Atom(X11Atom::Utf8String))
+        return QString::fromUtf8(data, len);
+    if (reply->type == XCB_ATOM_STRING)
+        return QString::fromLatin1(data, len);
+
+    return QString::fromLocal8Bit(data, len);
+}
+
+X11TitleRequest::X11TitleRequest(WId window)
+    : mVisibleName(x11RequestProperty(window,
+                                      x11Atom(X11Atom::NetWmVisibleName),
+                                      x11Atom(X11Atom::Utf8String))),
+      mName(x11RequestProperty(window, x11Atom(X11Atom::NetWmName),
+                               x11Atom(X11Atom::Utf8String))),
+      mWmName(x11RequestProperty(window, XCB_ATOM_WM_NAME, XCB_ATOM_ANY))
+{
+}
+
+QString X11TitleRequest::reply()
+{
+    // always collect all three replies so that none are leaked
+    auto visibleName = stringFromReply(x11PropertyReply(mVisibleName));
+    auto name = stringFromReply(x11PropertyReply(mName));
+    auto wmName = stringFromReply(x11PropertyReply(mWmName));
+
+    if (!visibleName.isEmpty())
+        return visibleName;
+    if (!name.isEmpty())
+        return name;
+
+    return wmName;
+}
+
+void X11TitleRequest::discard()
+{
+    auto conn = x11Connection();
+    xcb_discard_reply(conn, mVisibleName.sequence);
+    xcb_discard_reply(conn, mName.sequence);
+    xcb_discard_reply(conn, mWmName.sequence);
+}
+
+X11ClassRequest::X11ClassRequest(WId window)
+    : mCookie(x11RequestProperty(window, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING))
+{
+}
+
+std::pair<QString, QString> X11ClassRequest::reply()
+{
+    auto reply = x11PropertyReply(mCookie);
+    if (!reply || reply->format != 8)
+        return {};
+
+    // two consecutive null-terminated strings
+    auto data = static_cast<const char *>(xcb_get_property_value(reply.get()));
+    int len = xcb_get_property_value_length(reply.get());
+    int instanceLen = strnlen(data, len);
+    if (instanceLen >= len)
+        return {QString::fromLatin1(data, instanceLen), QString()};
+
+    auto wmClass = data + instanceLen + 1;
+    int classLen = strnlen(wmClass, len - instanceLen - 1);
+    return {QString::fromLatin1(data, instanceLen),
+            QString::fromLatin1(wmClass, classLen)};
+}
+
+void X11ClassRequest::discard()
+{
+    xcb_discard_reply(x11Connection(), mCookie.sequence);
+}
+
+X11IconRequest::X11IconRequest(WId window, int size,
+                               const X11IconHeaders * headers)
+    : mWindow(window), mSize(size), mPixels(nullptr, free)
+{
+    if (headers)
+    {
+        mHeaders = *headers;
+        mHeadersComplete = true;
+        requestPixels();
+    }
+    else
+        requestHeader(0);
+}
+
+void X11IconRequest::requestHeader(uint32_t offset)
+{
+    mState = ReadingHeaders;
+    mOffset = offset;
+    mCookie = x11RequestProperty(mWindow, x11Atom(X11Atom::NetWmIcon),
+                                 XCB_ATOM_CARDINAL, offset, 2);
+}
+
+// Prefer the smallest image at least as large as the target size,
+// otherwise the largest one available
+static bool betterIconSize(uint32_t width, uint32_t bestWidth, uint32_t size)
+{
+    if (!bestWidth)
+        return true;
+    if (bestWidth < size)
+        return width > bestWidth;
+
+    return width >= size && width < bestWidth;
+}
+
+void X11IconRequest::requestPixels()
+{
+    const X11IconHeader * best = nullptr;
+    for (auto & header : mHeaders)
+    {
+        if (betterIconSize(header.width, best ? best->width : 0, mSize))
+            best = &header;
+    }
+
+    if (!best)
+    {
+        mState = Done;
+        return;
+    }
+
+    mState = ReadingPixels;
+    mWidth = best->width;
+    mHeight = best->height;
+    mCookie = x11RequestProperty(mWindow, x11Atom(X11Atom::NetWmIcon),
+                                 XCB_ATOM_CARDINAL, best->offset + 2,
+                                 mWidth * mHeight);
+}
+
+bool X11IconRequest::step()
+{
+    if (mState == Done)
+        return false;
+
+    auto reply = x11PropertyReply(mCookie);
+    bool valid = (reply && reply->format == 32);
+    auto data = valid ? static_cast<const uint32_t *>(
+                            xcb_get_property_value(reply.get()))
+                      : nullptr;
+    size_t len = valid ? xcb_get_property_value_length(reply.get()) / 4 : 0;
+
+    if (mState == ReadingHeaders)
+    {
+        // Each image is preceded by its width and height.  Only these
+        // two values are read, then the image data itself is skipped.
+        size_t remaining = valid ? reply->bytes_after / 4 : 0;
+        uint32_t width = (len == 2) ? data[0] : 0;
+        uint32_t height = (len == 2) ? data[1] : 0;
+        uint64_t area = (uint64_t)width * height;
+
+        if (width && height && area <= remaining)
+        {
+            mHeaders.push_back({mOffset, width, height});
+            if (area < remaining)
+            {
+                requestHeader(mOffset + 2 + area);
+                return true;
+            }
+        }
+
+        mHeadersComplete = true;
+        requestPixels();
+        return (mState != Done);
+    }
+
+    // ReadingPixels
+    mState = Done;
+    if (len == (size_t)mWidth * mHeight)
+    {
+        size_t bytes = len * 4;
+        mHash = qHashMulti(0, mWidth, mHeight, qHashBits(data, bytes));
+        mPixels = std::move(reply);
+    }
+
+    return false;
+}
+
+void X11IconRequest::discard()
+{
+    if (mState != Done)
+        xcb_discard_reply(x11Connection(), mCookie.sequence);
+
+    mState = Done;
+    mHeadersComplete = false;
+    mHash = 0;
+    mPixels.reset();
+}
+
+QImage X11IconRequest::image() const
+{
+    if (!mPixels)
+        return QImage();
+
+    // each pixel is stored as a native-endian ARGB value
+    auto data =
+        static_cast<const uchar *>(xcb_get_property_value(mPixels.get()));
+    return QImage(data, mWidth, mHeight, QImage::Format_ARGB32).copy();
+}
@@ -0,0 +1,220 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef X11PROPS_H
+#define X11PROPS_H
+
+#include "utils.h"
+
+#include <QAbstractNativeEventFilter>
+#include <QImage>
+#include <QString>
+#include <functional>
+#include <unordered_set>
+#include <qwindowdefs.h>
+#include <vector>
+#include <xcb/xcb.h>
+
+enum class X11Atom
+{
+    NetWmIcon,
+    NetWmName,
+    NetWmState,
+    NetWmVisibleName,
+    NetWmWindowType,
+    Utf8String,
+    Count
+};
+
+xcb_connection_t * x11Connection();
+xcb_atom_t x11Atom(X11Atom atom);
+
+using X11PropertyReply = AutoPtrV<xcb_get_property_reply_t>;
+
+// Sends a GetProperty request without waiting for the reply.
+// Requests for many windows can be sent before collecting any
+// replies, so that they all share a single round-trip.
+xcb_get_property_cookie_t x11RequestProperty(WId window, xcb_atom_t property,
+                                             xcb_atom_t type,
+                                             uint32_t offset = 0,
+                                             uint32_t length = UINT32_MAX);
+X11PropertyReply x11PropertyReply(xcb_get_property_cookie_t cookie);
+
+// Sequence number of the next request on the connection, which counts
+// every request sent so far (including those sent internally by Qt or
+// KWindowSystem).  This costs a NoOperation request (but no round-trip)
+// and so is only meant for collecting statistics.
+uint32_t x11RequestSequence();
+
+// Adds the number of X11 requests sent during a scope to a counter
+// (see perfstats.h).  Does nothing unless statistics are enabled.
+class X11RequestCounter
+{
+public:
+    explicit X11RequestCounter(const char * name);
+    ~X11RequestCounter();
+
+private:
+    const char * mName;
+    uint32_t mStart = 0;
+};
+
+// Receives PropertyNotify events for selected windows directly from
+// the X server.  This replaces KX11Extras::windowChanged, which makes
+// KWindowSystem watch and re-read many properties of every window.
+class X11PropertyFilter : public QAbstractNativeEventFilter
+{
+public:
+    using Callback = std::function<void(WId window, xcb_atom_t atom)>;
+
+    explicit X11PropertyFilter(Callback callback);
+    ~X11PropertyFilter();
+
+    // Selecting is done in two steps, so that the event masks of many
+    // windows can be read in a single round-trip.  Events are received
+    // after the next call to flushSelections().
+    void selectWindow(WId window);
+    void flushSelections();
+    void forgetWindow(WId window) { mWindows.erase(window); }
+
+    bool nativeEventFilter(const QByteArray & eventType, void * message,
+                           qintptr * result) override;
+
+private:
+    Callback mCallback;
+    std::unordered_set<WId> mWindows;
+    std::vector<std::pair<WId, xcb_get_window_attributes_cookie_t>> mPending;
+};
+
+// Counts the X11 requests KWindowSystem sends internally when handling
+// a PropertyNotify event, i.e. in re-reading properties before emitting
+// KX11Extras::windowChanged.  Must be created after KWindowSystem's own
+// event filter (so that it sees each event first) and only while
+// statistics are enabled.
+class X11EventRequestCounter : public QAbstractNativeEventFilter
+{
+public:
+    explicit X11EventRequestCounter(const char * name);
+    ~X11EventRequestCounter();
+
+    // to be called from the handler of windowChanged; the requests are
+    // added to the counter only for events that were of interest
+    void finish(bool counted);
+
+    bool nativeEventFilter(const QByteArray & eventType, void * message,
+                           qintptr * result) override;
+
+private:
+    const char * mName;
+    uint32_t mStart = 0;
+    bool mStarted = false;
+};
+
+// Pending request for a window title (the same fallback order as
+// KWindowInfo::visibleName() and KWindowInfo::name())
+class X11TitleRequest
+{
+public:
+    explicit X11TitleRequest(WId window);
+    QString reply();
+    void discard(); // instead of reply()
+
+private:
+    xcb_get_property_cookie_t mVisibleName, mName, mWmName;
+};
+
+// Pending request for the WM_CLASS property (instance and class names)
+class X11ClassRequest
+{
+public:
+    explicit X11ClassRequest(WId window);
+    std::pair<QString, QString> reply();
+    void discard(); // instead of reply()
+
+private:
+    xcb_get_property_cookie_t mCookie;
+};
+
+// Location of one image within _NET_WM_ICON (offset in 32-bit units)
+struct X11IconHeader
+{
+    uint32_t offset, width, height;
+};
+
+using X11IconHeaders = std::vector<X11IconHeader>;
+
+// Pending request for a window icon (_NET_WM_ICON).  Some applications
+// provide images up to 512x512, so rather than transferring the whole
+// property, only the width/height headers are read at first and then
+// just the image closest in size to the requested pixel size.
+//
+// Each call to step() collects one reply and sends the next request.
+// Stepping many requests in turn lets them share round-trips.  Every
+// request must be stepped until it completes.
+class X11IconRequest
+{
+public:
+    // headers may be given if already known from a previous request
+    X11IconRequest(WId window, int size, const X11IconHeaders * headers);
+
+    // Returns false once the request is complete
+    bool step();
+    // Completes the request early, without an image
+    void discard();
+
+    // Only valid after the request is complete:
+    const X11IconHeaders * headers() const
+    {
+        return mHeadersComplete ? &mHeaders : nullptr;
+    }
+    // Hash of the chosen image, or 0 if the window has no usable icon
+    size_t hash() const { return mHash; }
+    QImage image() const;
+
+private:
+    enum State
+    {
+        ReadingHeaders,
+        ReadingPixels,
+        Done
+    };
+
+    void requestHeader(uint32_t offset);
+    void requestPixels();
+
+    WId mWindow;
+    uint32_t mSize;
+    State mState = Done;
+    xcb_get_property_cookie_t mCookie{};
+    uint32_t mOffset = 0;
+    X11IconHeaders mHeaders;
+    bool mHeadersComplete = false;
+    uint32_t mWidth = 0, mHeight = 0;
+    size_t mHash = 0;
+    X11PropertyReply mPixels;
+};
+
+#endif // X11PROPS_H
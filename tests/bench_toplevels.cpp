@@ -0,0 +1,187 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "testclient.h"
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QTest>
+
+// Times the Wayland side of the taskbar against TestCompositor, i.e.
+// handling of toplevel events without any rendering.  Each result is
+// the wall time per toplevel (a whole batch divided by the number of
+// toplevels in it), including the compositor's share of the work.
+// Run with "meson test --benchmark" (add -v to see the results).
+class BenchToplevels : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void openToplevels();
+    void closeToplevels();
+    void removeManager();
+    void updateTitles();
+
+private:
+    static constexpr int Toplevels = 1000;
+    // see test_toplevelmanager.cpp
+    static constexpr int Batch = 200;
+    static constexpr int Rounds = 20;
+
+    void announce();
+    void report(qint64 nsecs, int rounds);
+
+    std::unique_ptr<TestClient> mClient;
+};
+
+void BenchToplevels::init()
+{
+    mClient = std::make_unique<TestClient>();
+    mClient->compositor().toplevels = 0;
+    mClient->compositor().announceOnStop = false;
+    mClient->bindManager();
+    mClient->roundtrip();
+}
+
+void BenchToplevels::cleanup() { mClient.reset(); }
+
+void BenchToplevels::announce()
+{
+    for (int added = 0; added < Toplevels; added += Batch)
+    {
+        mClient->compositor().addToplevels(Batch);
+        mClient->roundtrip();
+    }
+}
+
+void BenchToplevels::report(qint64 nsecs, int rounds)
+{
+    QTest::setBenchmarkResult((qreal)nsecs / (rounds * Toplevels),
+                              QTest::WalltimeNanoseconds);
+}
+
+// new toplevels, each with a title, app ID and "done"
+void BenchToplevels::openToplevels()
+{
+    QElapsedTimer timer;
+    qint64 nsecs = 0;
+
+    for (int i = 0; i < Rounds; i++)
+    {
+        timer.start();
+        announce();
+        nsecs += timer.nsecsElapsed();
+        QCOMPARE(mClient->tasks(), Toplevels);
+
+        mClient->compositor().closeToplevels(Toplevels);
+        mClient->roundtrip();
+    }
+
+    report(nsecs, Rounds);
+}
+
+// "closed" for every toplevel, each of which has a button
+void BenchToplevels::closeToplevels()
+{
+    QElapsedTimer timer;
+    qint64 nsecs = 0;
+
+    for (int i = 0; i < Rounds; i++)
+    {
+        announce();
+        mClient->showTasks();
+
+        timer.start();
+        mClient->compositor().closeToplevels(Toplevels);
+        mClient->roundtrip();
+        nsecs += timer.nsecsElapsed();
+
+        QCOMPARE(mClient->tasks(), 0);
+        QCOMPARE(mClient->compositor().liveHandles(), 0);
+    }
+
+    report(nsecs, Rounds);
+}
+
+// the manager goes away with all its toplevels
+void BenchToplevels::removeManager()
+{
+    QElapsedTimer timer;
+    qint64 nsecs = 0;
+
+    for (int i = 0; i < Rounds; i++)
+    {
+        announce();
+        mClient->showTasks();
+
+        timer.start();
+        mClient->removeManager();
+        mClient->roundtrip();
+        nsecs += timer.nsecsElapsed();
+
+        QCOMPARE(mClient->tasks(), 0);
+        QCOMPARE(mClient->compositor().liveHandles(), 0);
+
+        mClient->bindManager();
+        mClient->roundtrip();
+    }
+
+    report(nsecs, Rounds);
+}
+
+// one title change (with "done") for every toplevel
+void BenchToplevels::updateTitles()
+{
+    announce();
+    mClient->showTasks();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < Rounds; i++)
+    {
+        mClient->compositor().retitleAll();
+        mClient->roundtrip();
+    }
+
+    report(timer.nsecsElapsed(), Rounds);
+}
+
+int main(int argc, char ** argv)
+{
+    // TaskBar must not find a real display or the user's settings
+    isolateEnvironment();
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+    BenchToplevels bench;
+    return QTest::qExec(&bench, argc, argv);
+}
+
+#include "bench_toplevels.moc"
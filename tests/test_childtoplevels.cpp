@@ -0,0 +1,99 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "testclient.h"
+
+#include <QApplication>
+#include <QTest>
+
+// Child toplevels (e.g. dialogs) have no buttons of their own but keep
+// their parent's button checked while focused
+class TestChildToplevels : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void childActivatedFirst();
+
+private:
+    std::unique_ptr<TestClient> mClient;
+};
+
+void TestChildToplevels::init()
+{
+    mClient = std::make_unique<TestClient>();
+    mClient->compositor().toplevels = 2;
+    mClient->compositor().announceOnStop = false;
+    mClient->bindManager();
+    mClient->roundtrip();
+}
+
+void TestChildToplevels::cleanup() { mClient.reset(); }
+
+// The compositor may send the parent's deactivation after the child's
+// activation, and later updates of the parent must not uncheck its
+// button either
+void TestChildToplevels::childActivatedFirst()
+{
+    auto & compositor = mClient->compositor();
+    compositor.setTitle(0, "Parent");
+    compositor.setTitle(1, "Dialog");
+    compositor.setParent(1, 0);
+    compositor.setActivated(0, true);
+    mClient->roundtrip();
+    QCOMPARE(mClient->tasks(), 1);
+    QCOMPARE(mClient->activeTitle(), QString("Parent"));
+
+    compositor.setActivated(1, true);
+    compositor.setActivated(0, false);
+    mClient->roundtrip();
+    QCOMPARE(mClient->activeTitle(), QString("Parent"));
+
+    compositor.setTitle(0, "Parent (renamed)");
+    mClient->roundtrip();
+    QCOMPARE(mClient->activeTitle(), QString("Parent (renamed)"));
+
+    // with neither focused, no button is checked
+    compositor.setActivated(1, false);
+    mClient->roundtrip();
+    QCOMPARE(mClient->activeTitle(), QString());
+}
+
+int main(int argc, char ** argv)
+{
+    // TaskBar must not find a real display or the user's settings
+    isolateEnvironment();
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+    TestChildToplevels test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "test_childtoplevels.moc"
@@ -0,0 +1,115 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "../panel/taskmodel.h"
+
+#include <QTest>
+
+class TestTaskModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void addRemove();
+    void transientTask();
+    void dialogActivatedBeforeFlush();
+    void transientBecomesTask();
+};
+
+void TestTaskModel::addRemove()
+{
+    TaskModel model;
+    model.add(1);
+    model.add(2);
+    model.add(3);
+    model.remove(2);
+
+    QVERIFY(model.contains(1));
+    QVERIFY(!model.contains(2));
+    QCOMPARE(model.find(3)->id, WId(3));
+    QCOMPARE(model.begin()[1].id, WId(3));
+}
+
+void TestTaskModel::transientTask()
+{
+    TaskModel model;
+    model.add(1);
+    model.setTransientFor(2, 1);
+    model.setTransientFor(3, 2); // nested dialog
+
+    QCOMPARE(model.findTask(1), WId(1));
+    QCOMPARE(model.findTask(3), WId(1));
+    QCOMPARE(model.findTask(4), WId(0));
+
+    model.setTransientFor(2, 0);
+    QCOMPARE(model.findTask(3), WId(0));
+
+    // loops must not hang
+    model.setTransientFor(5, 6);
+    model.setTransientFor(6, 5);
+    QCOMPARE(model.findTask(5), WId(0));
+}
+
+// The order of events seen by TaskBar when a dialog is mapped and
+// focused before its WM_TRANSIENT_FOR has been read
+void TestTaskModel::dialogActivatedBeforeFlush()
+{
+    TaskModel model;
+    model.add(1);
+    model.setActiveWindow(1);
+    QCOMPARE(model.activeTask(), WId(1));
+
+    // the dialog is not known yet, so no task is active
+    model.setActiveWindow(2);
+    QCOMPARE(model.activeTask(), WId(0));
+
+    // once the properties are read, the owner is active again
+    model.setTransientFor(2, 1);
+    QCOMPARE(model.activeTask(), WId(1));
+
+    model.remove(1);
+    QCOMPARE(model.activeTask(), WId(0));
+}
+
+// a window that stops being transient becomes a task of its own
+void TestTaskModel::transientBecomesTask()
+{
+    TaskModel model;
+    model.add(1);
+    model.setTransientFor(2, 1);
+    model.setActiveWindow(2);
+    QCOMPARE(model.activeTask(), WId(1));
+
+    model.setTransientFor(2, 0);
+    QCOMPARE(model.activeTask(), WId(0));
+
+    model.add(2);
+    QCOMPARE(model.activeTask(), WId(2));
+}
+
+QTEST_APPLESS_MAIN(TestTaskModel)
+
+#include "test_taskmodel.moc"
@@ -0,0 +1,215 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "testclient.h"
+
+#include <QApplication>
+#include <QTest>
+
+// Checks that no toplevel handles are leaked on the compositor side,
+// and no tasks or buttons on the panel side, however the toplevels or
+// the manager go away
+class TestToplevelManager : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void closeToplevels();
+    void removeGlobal();
+    void compositorFinished();
+    void stopWhileEventsInFlight();
+    void destroyTaskBar();
+
+private:
+    static constexpr int Toplevels = 2000;
+    // toplevels announced at once (more might not fit in the socket
+    // buffer, since the compositor does not wait for the client)
+    static constexpr int Batch = 200;
+    static constexpr int Rounds = 10;
+
+    void bindManager();
+    void addToplevels(int count);
+    void checkEmpty();
+
+    std::unique_ptr<TestClient> mClient;
+};
+
+void TestToplevelManager::init()
+{
+    mClient = std::make_unique<TestClient>();
+    mClient->compositor().toplevels = Batch;
+}
+
+void TestToplevelManager::cleanup() { mClient.reset(); }
+
+// binds the manager and fills up to the full number of toplevels
+void TestToplevelManager::bindManager()
+{
+    auto & compositor = mClient->compositor();
+    mClient->bindManager();
+    mClient->roundtrip();
+    addToplevels(Toplevels - Batch);
+    QCOMPARE(compositor.managers(), 1);
+    QCOMPARE(compositor.liveHandles(), Toplevels);
+    QCOMPARE(mClient->tasks(), Toplevels);
+
+    // so that buttons are taken from the pool and returned to it
+    mClient->showTasks();
+    QVERIFY(mClient->boundButtons() > 0);
+}
+
+void TestToplevelManager::addToplevels(int count)
+{
+    for (int added = 0; added < count; added += Batch)
+    {
+        mClient->compositor().addToplevels(std::min(Batch, count - added));
+        mClient->roundtrip();
+    }
+}
+
+void TestToplevelManager::checkEmpty()
+{
+    QCOMPARE(mClient->compositor().liveHandles(), 0);
+    QCOMPARE(mClient->tasks(), 0);
+    QCOMPARE(mClient->toplevels(), 0);
+    QCOMPARE(mClient->boundButtons(), 0);
+    QVERIFY(mClient->spareButtons() <= mClient->maxSpareButtons());
+}
+
+// toplevels come and go while the manager stays bound
+void TestToplevelManager::closeToplevels()
+{
+    auto & compositor = mClient->compositor();
+    compositor.announceOnStop = false;
+    bindManager();
+
+    for (int i = 0; i < Rounds; i++)
+    {
+        // close half, open as many again, then close all
+        compositor.closeToplevels(Toplevels / 2);
+        addToplevels(Toplevels / 2);
+        QCOMPARE(compositor.liveHandles(), Toplevels);
+        QCOMPARE(mClient->tasks(), Toplevels);
+        QCOMPARE(mClient->toplevels(), Toplevels);
+
+        mClient->showTasks();
+        compositor.closeToplevels(Toplevels);
+        mClient->roundtrip();
+        checkEmpty();
+
+        addToplevels(Toplevels);
+        mClient->showTasks();
+    }
+
+    mClient->removeManager();
+    mClient->roundtrip();
+    QCOMPARE(compositor.managers(), 0);
+    checkEmpty();
+}
+
+// the global disappears and re-appears repeatedly
+void TestToplevelManager::removeGlobal()
+{
+    auto & compositor = mClient->compositor();
+
+    for (int i = 0; i < Rounds; i++)
+    {
+        bindManager();
+
+        mClient->removeManager();
+        mClient->roundtrip();
+        QCOMPARE(compositor.managers(), 0);
+        checkEmpty();
+    }
+}
+
+void TestToplevelManager::compositorFinished()
+{
+    for (int i = 0; i < Rounds; i++)
+    {
+        bindManager();
+
+        mClient->compositor().finishAll();
+        mClient->roundtrip();
+        checkEmpty();
+    }
+}
+
+// A toplevel announced between "stop" and "finished" must still be
+// destroyed, and the manager can be bound again before "finished"
+void TestToplevelManager::stopWhileEventsInFlight()
+{
+    auto & compositor = mClient->compositor();
+    compositor.announceOnStop = true;
+
+    for (int i = 0; i < Rounds; i++)
+    {
+        bindManager();
+
+        // no roundtrip between these two
+        mClient->removeManager();
+        mClient->bindManager();
+        mClient->roundtrip();
+        QCOMPARE(compositor.managers(), 1);
+        QCOMPARE(compositor.liveHandles(), Batch);
+        QCOMPARE(mClient->tasks(), Batch);
+        QCOMPARE(mClient->toplevels(), Batch);
+
+        mClient->removeManager();
+        mClient->roundtrip();
+        checkEmpty();
+    }
+
+    QVERIFY(compositor.createdHandles() > Rounds * (Toplevels + Batch));
+}
+
+void TestToplevelManager::destroyTaskBar()
+{
+    auto & compositor = mClient->compositor();
+    compositor.announceOnStop = false;
+    bindManager();
+
+    mClient->destroyTaskBar();
+    mClient->roundtrip();
+    QCOMPARE(compositor.managers(), 0);
+    QCOMPARE(compositor.liveHandles(), 0);
+}
+
+int main(int argc, char ** argv)
+{
+    // TaskBar must not find a real display or the user's settings
+    isolateEnvironment();
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+    TestToplevelManager test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "test_toplevelmanager.moc"
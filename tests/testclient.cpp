@@ -0,0 +1,156 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "testclient.h"
+#include "../panel/taskbutton.h"
+#include "wlr-foreign-toplevel-management-unstable-v1.h"
+
+#include <QTemporaryDir>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-client.h>
+
+void restore_signals(void *) {} // see main.cpp
+
+void isolateEnvironment()
+{
+    static QTemporaryDir dir;
+    if (!dir.isValid())
+    {
+        fprintf(stderr, "Could not create temporary directory\n");
+        abort();
+    }
+
+    auto path = dir.path().toUtf8();
+    for (auto name : {"HOME", "XDG_CONFIG_HOME", "XDG_CONFIG_DIRS",
+                      "XDG_DATA_HOME", "XDG_DATA_DIRS", "XDG_CACHE_HOME"})
+        qputenv(name, path);
+}
+
+TestClient::TestClient()
+{
+    static const wl_registry_listener listener = {
+        .global =
+            [](void * data, wl_registry *, uint32_t name,
+               const char * interface, uint32_t version) {
+                auto self = static_cast<TestClient *>(data);
+                if (!strcmp(interface,
+                            zwlr_foreign_toplevel_manager_v1_interface.name))
+                {
+                    self->mManagerName = name;
+                    self->mManagerVersion = version;
+                }
+            },
+        .global_remove = [](void *, wl_registry *, uint32_t) {},
+    };
+
+    mDisplay = wl_display_connect_to_fd(mCompositor.clientFd());
+    if (!mDisplay)
+    {
+        fprintf(stderr, "Could not connect to test compositor\n");
+        abort();
+    }
+
+    mRegistry = wl_display_get_registry(mDisplay);
+    wl_registry_add_listener(mRegistry, &listener, this);
+    roundtrip();
+
+    mTaskBar = std::make_unique<TaskBar>(mRes, nullptr);
+}
+
+TestClient::~TestClient()
+{
+    mTaskBar.reset();
+    wl_registry_destroy(mRegistry);
+    wl_display_disconnect(mDisplay);
+}
+
+void TestClient::bindManager()
+{
+    mTaskBar->addToplevelManager(mRegistry, mManagerName, mManagerVersion);
+}
+
+void TestClient::removeManager() { mTaskBar->removeGlobal(mManagerName); }
+
+int TestClient::boundButtons() const
+{
+    // TaskButton has no Q_OBJECT macro, so qobject_cast cannot be used
+    int count = 0;
+    for (auto child : mTaskBar->findChildren<QToolButton *>())
+    {
+        auto button = dynamic_cast<TaskButton *>(child);
+        if (button && button->task())
+            count++;
+    }
+
+    return count;
+}
+
+QString TestClient::activeTitle() const
+{
+    auto task = mTaskBar->mModel.find(mTaskBar->mActiveTask);
+    return task ? task->title : QString();
+}
+
+void TestClient::showTasks()
+{
+    for (auto & task : mTaskBar->mModel)
+        task.addedAt -= TaskBar::GracePeriod;
+
+    mTaskBar->realizeTasks();
+    mTaskBar->updateLayout();
+}
+
+// Large batches of events take several passes, since each side only
+// buffers so much at a time
+void TestClient::roundtrip()
+{
+    int idle = 0;
+    while (idle < 2)
+    {
+        wl_display_flush(mDisplay);
+        mCompositor.dispatch();
+
+        while (wl_display_prepare_read(mDisplay) != 0)
+            wl_display_dispatch_pending(mDisplay);
+
+        pollfd fd = {wl_display_get_fd(mDisplay), POLLIN, 0};
+        if (poll(&fd, 1, 0) > 0)
+        {
+            wl_display_read_events(mDisplay);
+            idle = 0;
+        }
+        else
+        {
+            wl_display_cancel_read(mDisplay);
+            idle++;
+        }
+
+        wl_display_dispatch_pending(mDisplay);
+    }
+}
@@ -0,0 +1,89 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef TESTCLIENT_H
+#define TESTCLIENT_H
+
+#include "../panel/resources.h"
+#include "../panel/taskbar.h"
+#include "testcompositor.h"
+
+#include <memory>
+
+struct wl_display;
+struct wl_registry;
+
+// Points HOME and the XDG directories at an empty directory, so that
+// Resources reads no user settings or .desktop files.  Must be called at
+// the start of main(), before GLib or Qt look at any of them.
+void isolateEnvironment();
+
+// A TaskBar connected to a TestCompositor.  Under the offscreen platform
+// TaskBar has no Wayland connection of its own, so the manager global is
+// passed to it by hand.  Requires a QApplication.
+class TestClient
+{
+public:
+    TestClient();
+    ~TestClient();
+
+    TestCompositor & compositor() { return mCompositor; }
+    TaskBar & taskBar() { return *mTaskBar; }
+
+    // panel-side state
+    int tasks() const { return (int)mTaskBar->mModel.size(); }
+    int toplevels() const { return (int)mTaskBar->mToplevels.size(); }
+    int boundButtons() const;
+    int spareButtons() const { return (int)mTaskBar->mSpareButtons.size(); }
+    int maxSpareButtons() const { return TaskBar::MaxSpareButtons; }
+    // title of the task whose button is checked, if any
+    QString activeTitle() const;
+
+    // Shows all tasks now rather than after the grace period, so that
+    // they get buttons
+    void showTasks();
+
+    // as if the registry had announced or removed the global
+    void bindManager();
+    void removeManager();
+
+    void destroyTaskBar() { mTaskBar.reset(); }
+
+    // Passes messages back and forth until both sides are idle.  Events
+    // are read without blocking, since the compositor runs in this
+    // thread.
+    void roundtrip();
+
+private:
+    TestCompositor mCompositor;
+    wl_display * mDisplay = nullptr;
+    wl_registry * mRegistry = nullptr;
+    uint32_t mManagerName = 0, mManagerVersion = 0;
+    Resources mRes;
+    std::unique_ptr<TaskBar> mTaskBar;
+};
+
+#endif // TESTCLIENT_H
@@ -0,0 +1,235 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "testcompositor.h"
+#include "wlr-foreign-toplevel-management-unstable-v1-server.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <wayland-server.h>
+
+static TestCompositor * fromResource(wl_resource * resource)
+{
+    return static_cast<TestCompositor *>(wl_resource_get_user_data(resource));
+}
+
+static void destroyResource(wl_client *, wl_resource * resource)
+{
+    wl_resource_destroy(resource);
+}
+
+TestCompositor::TestCompositor() : mDisplay(wl_display_create())
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+    {
+        perror("socketpair");
+        return;
+    }
+
+    mClient = wl_client_create(mDisplay, fds[0]);
+    mClientFd = fds[1];
+    addGlobal();
+}
+
+TestCompositor::~TestCompositor()
+{
+    // destroys the client along with all its resources
+    wl_display_destroy_clients(mDisplay);
+    wl_display_destroy(mDisplay);
+}
+
+void TestCompositor::dispatch()
+{
+    wl_event_loop_dispatch(wl_display_get_event_loop(mDisplay), 0);
+    wl_display_flush_clients(mDisplay);
+}
+
+void TestCompositor::addGlobal()
+{
+    if (!mGlobal)
+        mGlobal = wl_global_create(mDisplay,
+                                   &zwlr_foreign_toplevel_manager_v1_interface,
+                                   3, this, bind);
+}
+
+void TestCompositor::removeGlobal()
+{
+    if (mGlobal)
+        wl_global_destroy(mGlobal);
+
+    mGlobal = nullptr;
+}
+
+void TestCompositor::finishAll()
+{
+    while (!mManagers.empty())
+        finish(mManagers.back());
+
+    wl_display_flush_clients(mDisplay);
+}
+
+void TestCompositor::addToplevels(int count)
+{
+    for (auto manager : mManagers)
+    {
+        for (int i = 0; i < count; i++)
+            announce(manager);
+    }
+
+    wl_display_flush_clients(mDisplay);
+}
+
+void TestCompositor::closeToplevels(int count)
+{
+    count = std::min(count, openToplevels());
+    for (int i = 0; i < count; i++)
+        zwlr_foreign_toplevel_handle_v1_send_closed(mHandles[i]);
+
+    mClosedHandles.insert(mClosedHandles.end(), mHandles.begin(),
+                          mHandles.begin() + count);
+    mHandles.erase(mHandles.begin(), mHandles.begin() + count);
+    wl_display_flush_clients(mDisplay);
+}
+
+void TestCompositor::retitleAll()
+{
+    mTitleChanges++;
+    for (auto handle : mHandles)
+    {
+        char title[32];
+        snprintf(title, sizeof title, "Title %d", mTitleChanges);
+        zwlr_foreign_toplevel_handle_v1_send_title(handle, title);
+        zwlr_foreign_toplevel_handle_v1_send_done(handle);
+    }
+
+    wl_display_flush_clients(mDisplay);
+}
+
+void TestCompositor::setTitle(int index, const char * title)
+{
+    zwlr_foreign_toplevel_handle_v1_send_title(mHandles[index], title);
+    zwlr_foreign_toplevel_handle_v1_send_done(mHandles[index]);
+    wl_display_flush_clients(mDisplay);
+}
+
+void TestCompositor::setParent(int index, int parent)
+{
+    zwlr_foreign_toplevel_handle_v1_send_parent(
+        mHandles[index], (parent >= 0) ? mHandles[parent] : nullptr);
+    zwlr_foreign_toplevel_handle_v1_send_done(mHandles[index]);
+    wl_display_flush_clients(mDisplay);
+}
+
+void TestCompositor::setActivated(int index, bool activated)
+{
+    wl_array state;
+    wl_array_init(&state);
+    if (activated)
+    {
+        auto entry = static_cast<uint32_t *>(
+            wl_array_add(&state, sizeof(uint32_t)));
+        *entry = ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED;
+    }
+
+    zwlr_foreign_toplevel_handle_v1_send_state(mHandles[index], &state);
+    zwlr_foreign_toplevel_handle_v1_send_done(mHandles[index]);
+    wl_array_release(&state);
+    wl_display_flush_clients(mDisplay);
+}
+
+void TestCompositor::bind(wl_client * client, void * data, uint32_t version,
+                          uint32_t id)
+{
+    static const struct zwlr_foreign_toplevel_manager_v1_interface impl = {
+        .stop = stop,
+    };
+
+    auto self = static_cast<TestCompositor *>(data);
+    auto manager = wl_resource_create(
+        client, &zwlr_foreign_toplevel_manager_v1_interface, version, id);
+    wl_resource_set_implementation(manager, &impl, self, managerDestroyed);
+    self->mManagers.push_back(manager);
+
+    for (int i = 0; i < self->toplevels; i++)
+        self->announce(manager);
+}
+
+void TestCompositor::stop(wl_client *, wl_resource * manager)
+{
+    auto self = fromResource(manager);
+    if (self->announceOnStop)
+        self->announce(manager);
+
+    self->finish(manager);
+}
+
+void TestCompositor::managerDestroyed(wl_resource * manager)
+{
+    auto & managers = fromResource(manager)->mManagers;
+    managers.erase(std::remove(managers.begin(), managers.end(), manager),
+                   managers.end());
+}
+
+void TestCompositor::handleDestroyed(wl_resource * handle)
+{
+    auto self = fromResource(handle);
+    for (auto handles : {&self->mHandles, &self->mClosedHandles})
+        handles->erase(std::remove(handles->begin(), handles->end(), handle),
+                       handles->end());
+}
+
+void TestCompositor::announce(wl_resource * manager)
+{
+    // only "destroy" is expected from the panel in these tests
+    static const struct zwlr_foreign_toplevel_handle_v1_interface impl = {
+        .destroy = destroyResource,
+    };
+
+    auto handle = wl_resource_create(
+        wl_resource_get_client(manager),
+        &zwlr_foreign_toplevel_handle_v1_interface,
+        wl_resource_get_version(manager), 0);
+    wl_resource_set_implementation(handle, &impl, this, handleDestroyed);
+    mHandles.push_back(handle);
+    mCreatedHandles++;
+
+    char title[32];
+    snprintf(title, sizeof title, "Window %d", mCreatedHandles);
+
+    zwlr_foreign_toplevel_manager_v1_send_toplevel(manager, handle);
+    zwlr_foreign_toplevel_handle_v1_send_title(handle, title);
+    zwlr_foreign_toplevel_handle_v1_send_app_id(handle, "test");
+    zwlr_foreign_toplevel_handle_v1_send_done(handle);
+}
+
+// the manager is destroyed right after "finished" (see the protocol)
+void TestCompositor::finish(wl_resource * manager)
+{
+    zwlr_foreign_toplevel_manager_v1_send_finished(manager);
+    wl_resource_destroy(manager);
+}
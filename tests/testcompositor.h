@@ -0,0 +1,107 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)LGPL2+
+ *
+ * qmpanel - a minimal Qt-based desktop panel
+ *
+ * Copyright: 2026 John Lindgren
+ * Authors:
+ *   John Lindgren <john@jlindgren.net>
+ *
+ * This program or library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301 USA
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef TESTCOMPOSITOR_H
+#define TESTCOMPOSITOR_H
+
+#include <stdint.h>
+#include <vector>
+
+struct wl_client;
+struct wl_display;
+struct wl_global;
+struct wl_resource;
+
+// Minimal in-process Wayland server offering only the foreign toplevel
+// manager global.  It serves a single client over a socket pair and is
+// driven by hand (see dispatch()), so tests need no threads.
+class TestCompositor
+{
+public:
+    TestCompositor();
+    ~TestCompositor();
+
+    // the client end of the connection, for wl_display_connect_to_fd()
+    int clientFd() const { return mClientFd; }
+
+    // handles events from the client and sends any queued replies
+    void dispatch();
+
+    void addGlobal();
+    void removeGlobal();
+
+    // number of toplevels announced to each newly bound manager
+    int toplevels = 3;
+    // announce one more toplevel between "stop" and "finished"
+    bool announceOnStop = true;
+
+    // sends "finished" to all managers without waiting for "stop"
+    void finishAll();
+    // announces more toplevels to all managers
+    void addToplevels(int count);
+    // sends "closed" for the oldest toplevels (the panel then destroys
+    // their handles)
+    void closeToplevels(int count);
+    // sends a new title (and "done") for every toplevel
+    void retitleAll();
+
+    // change one open toplevel (by index, oldest first) and send "done"
+    void setTitle(int index, const char * title);
+    void setParent(int index, int parent); // -1 for none
+    void setActivated(int index, bool activated);
+
+    int managers() const { return (int)mManagers.size(); }
+    // toplevels not yet closed
+    int openToplevels() const { return (int)mHandles.size(); }
+    // handles not yet destroyed by the panel, including closed ones
+    int liveHandles() const
+    {
+        return (int)(mHandles.size() + mClosedHandles.size());
+    }
+    int createdHandles() const { return mCreatedHandles; }
+
+private:
+    static void bind(wl_client * client, void * data, uint32_t version,
+                     uint32_t id);
+    static void stop(wl_client * client, wl_resource * manager);
+    static void managerDestroyed(wl_resource * manager);
+    static void handleDestroyed(wl_resource * handle);
+
+    void announce(wl_resource * manager);
+    void finish(wl_resource * manager);
+
+    wl_display * mDisplay;
+    wl_client * mClient = nullptr;
+    wl_global * mGlobal = nullptr;
+    int mClientFd = -1;
+    std::vector<wl_resource *> mManagers;
+    std::vector<wl_resource *> mHandles;
+    std::vector<wl_resource *> mClosedHandles;
+    int mCreatedHandles = 0;
+    int mTitleChanges = 0;
+};
+
+#endif // TESTCOMPOSITOR_H